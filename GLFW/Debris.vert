@@ -0,0 +1,25 @@
+#version 330 core
+
+// input data : the corners of a unit square, and for every fragment (instance) where it is and its color
+layout (location = 0) in vec2 vertexPosition;
+layout (location = 2) in vec4 instancePlace; // x, y, angle (radians), size
+layout (location = 3) in vec4 instanceColor; // r, g, b, life left (0 to 1)
+
+uniform mat4 VP;
+uniform float depth; // In front of the sprites drawn before the debris (See Render queue)
+
+// output data : used by fragment shader
+out vec3 fragColor;
+
+void main ()
+{
+    // Turn and scale the square, it shrinks away at the end of its life
+    vec2 corner = vertexPosition * instancePlace.w * instanceColor.a;
+    float c = cos(instancePlace.z), s = sin(instancePlace.z);
+    vec2 position = instancePlace.xy + vec2(c*corner.x - s*corner.y, s*corner.x + c*corner.y);
+
+    fragColor = instanceColor.rgb;
+
+    // Output position of the vertex, in clip space : VP * position
+    gl_Position = VP * vec4(position, depth, 1);
+}
@@ -1,22 +1,36 @@
 #version 330 core
 
 // input data : sent from main program
-layout (location = 0) in vec3 vertexPosition;
-layout (location = 1) in vec3 vertexColor;
+layout (location = 0) in vec2 vertexPosition;
+layout (location = 1) in vec4 vertexCorner; // How much of each corner color the vertex takes
 
-uniform mat4 MVP;
+// for every sprite (instance) : where it is and its colors
+layout (location = 2) in vec4 instancePlace; // x, y and the rotation as (cos, sin)
+layout (location = 3) in vec3 instanceScale; // Size of the mesh (x, y) and the depth
+layout (location = 4) in vec4 instanceColor0;
+layout (location = 5) in vec4 instanceColor1;
+layout (location = 6) in vec4 instanceColor2;
+layout (location = 7) in vec4 instanceColor3;
+
+uniform mat4 VP;
 
 // output data : used by fragment shader
 out vec3 fragColor;
 
 void main ()
 {
-    vec4 v = vec4(vertexPosition, 1); // Transform an homogeneous 4D vector
+    // Scale, then turn, then move the mesh
+    float c = instancePlace.z, s = instancePlace.w;
+    mat4 model = mat4(vec4(c*instanceScale.x, s*instanceScale.x, 0, 0),
+                      vec4(-s*instanceScale.y, c*instanceScale.y, 0, 0),
+                      vec4(0, 0, 1, 0),
+                      vec4(instancePlace.xy, instanceScale.z, 1));
+    vec4 v = vec4(vertexPosition, 0, 1); // Transform an homogeneous 4D vector
 
     // The color of each vertex will be interpolated
     // to produce the color of each fragment
-    fragColor = vertexColor;
+    fragColor = instanceColor0.rgb*vertexCorner.x + instanceColor1.rgb*vertexCorner.y + instanceColor2.rgb*vertexCorner.z + instanceColor3.rgb*vertexCorner.w;
 
-    // Output position of the vertex, in clip space : MVP * position
-    gl_Position = MVP * v;
+    // Output position of the vertex, in clip space : VP * model * position
+    gl_Position = VP * model * v;
 }
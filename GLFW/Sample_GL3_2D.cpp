@@ -3,6 +3,11 @@
 #include <fstream>
 #include <vector>
 #include <map>
+#include <algorithm>
+#include <cstddef>
+#if defined(__SSE__)
+#include <immintrin.h>
+#endif
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -12,47 +17,51 @@
 #include <glm/gtx/transform.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include "Simulation.h"
+
 using namespace std;
 
+//A corner of a mesh triangle, the position and the color are interleaved in one buffer
+struct Vertex {
+    GLfloat x,y;
+    GLubyte corner[4]; //How much of each of the 4 corner colors it takes, 255 is all (See Mesh cache)
+};
+typedef struct Vertex Vertex;
+
+//Where and how a sprite is drawn, the per instance attributes of Sample_GL.vert
+struct SpriteInstance {
+    GLfloat place[4]; //x, y and the rotation as its cosine and sine
+    GLfloat scale[3]; //Size of the mesh (x,y) and the depth (See Render queue)
+    GLubyte colors[4][4]; //RGBA of the corners
+};
+typedef struct SpriteInstance SpriteInstance;
+
 struct VAO {
     GLuint VertexArrayID;
     GLuint VertexBuffer;
-    GLuint ColorBuffer;
+    GLuint InstanceBuffer;
 
     GLenum PrimitiveMode;
     GLenum FillMode;
     int NumVertices;
+    vector<SpriteInstance> Instances; //Sprites to draw this frame (See flushRenderQueue)
+    int InstanceCapacity; //Instances the instance buffer has room for
+    int MeshID; //In the sort keys of the render queue
 };
 typedef struct VAO VAO;
 
-struct COLOR {
-    float r;
-    float g;
-    float b;
-};
-typedef struct COLOR COLOR;
-
 struct Sprite {
     string name;
     COLOR color;
+    COLOR colors[4]; //Corners of a rectangle (bottom left, top left, top right, bottom right), circles and triangles use the first
     float x,y;
-    VAO* object;
+    VAO* object; //Shared with the other sprites of the same shape
+    float scale_x,scale_y; //Size the mesh is drawn at
     int status;
     float height,width;
-    float x_speed,y_speed;
     float angle; //Current Angle (Actual rotated angle of the object)
-    int inAir;
     float radius;
-    int fixed;
-    float friction; //Value from 0 to 1
-    int health;
-    int isRotating;
-    int direction; //0 for clockwise and 1 for anticlockwise for animation
-    float remAngle; //the remaining angle to finish animation
-    int isMovingAnim;
-    int dx;
-    int dy;
-    float weight;
+    int depth; //Order of creation in its component, drawn over the sprites created before it (See storeSprite)
 };
 typedef struct Sprite Sprite;
 
@@ -65,14 +74,11 @@ struct GLMatrices {
 
 map <string, Sprite> objects;
 map <string, Sprite> cannonObjects; //Only store cannon components here
-map <string, Sprite> coins;
+map <string, Sprite> pickupObjects; //Coins and goals
 map <string, Sprite> backgroundObjects;
-map <string, Sprite> goalObjects;
 
-map <string, Sprite> pig1Objects; //Pig1
-map <string, Sprite> pig2Objects; //Pig2
-map <string, Sprite> pig3Objects; //Pig3
-map <string, Sprite> pig4Objects; //Pig4
+map <string, Sprite> pigObjects; //Ears, eyes and nose drawn around every pig
+map <string, Sprite> statsObjects; //Bars of the physics readout
 
 map <string, Sprite> char1Objects; //The score displayed on top right of the screen
 map <string, Sprite> char2Objects;
@@ -103,24 +109,21 @@ char characterValues[10];
 float characterPosX[10];
 float characterPosY[10];
 
-int scoreDrawTimer=0;
-int player_score=0;
 float x_change = 0; //For the camera pan
 float y_change = 0; //For the camera pan
 float zoom_camera = 1;
-float gravity = 1;
-float airResistance = 0.2/15;
-int player_reset_timer=0;
-double click_time=0;
+float zoom_min = 1; //Below 1 for levels bigger than the window
+float map_left=-400, map_right=400, map_bottom=-300, map_top=300; //Where the camera can go, the middle of the walls, floor and roof
+double click_time=0; //When the last shot was fired, -1 once the cannonball was put back
 float game_over=0;
 float game_start_timer=0;
 int game_timer=90;
-
-pair<float,float> moveObject(string name, float dx, float dy) {
-    objects[name].x+=dx;
-    objects[name].y+=dy;
-    return make_pair(objects[name].x,objects[name].y);
-}
+int show_physics_stats=0; //Toggled with 'P', shows where the time of a physics step goes and prints the counters every 0.5s
+PhysicsStats stats_sum = {}; //Of the steps since the counters were last printed
+int stats_steps=0;
+PhysicsStats stats_shown = {}; //Average step of the last 0.5s
+int preview_budget_us=300; //Time the trajectory preview may take per frame
+int rewind_seconds=10; //How far back the last shot can still be taken back with 'U'
 
 GLuint programID;
 
@@ -214,92 +217,464 @@ void quit(GLFWwindow *window)
 }
 
 
+int meshes_created=0;
+
 /* Generate VAO, VBOs and return VAO handle */
-struct VAO* create3DObject (GLenum primitive_mode, int numVertices, GLfloat* vertex_buffer_data, GLfloat* color_buffer_data, GLenum fill_mode=GL_FILL)
+struct VAO* create3DObject (GLenum primitive_mode, int numVertices, const Vertex* vertices, GLenum fill_mode=GL_FILL)
 {
     struct VAO* vao = new struct VAO;
+    vao->MeshID = meshes_created++;
     vao->PrimitiveMode = primitive_mode;
     vao->NumVertices = numVertices;
+    vao->InstanceCapacity = 0;
     vao->FillMode = fill_mode;
 
     // Create Vertex Array Object
     // Should be done after CreateWindow and before any other GL calls
     glGenVertexArrays(1, &(vao->VertexArrayID)); // VAO
     glGenBuffers (1, &(vao->VertexBuffer)); // VBO - vertices
-    glGenBuffers (1, &(vao->ColorBuffer));  // VBO - colors
+    glGenBuffers (1, &(vao->InstanceBuffer));  // VBO - sprites
 
     glBindVertexArray (vao->VertexArrayID); // Bind the VAO
     glBindBuffer (GL_ARRAY_BUFFER, vao->VertexBuffer); // Bind the VBO vertices
-    glBufferData (GL_ARRAY_BUFFER, 3*numVertices*sizeof(GLfloat), vertex_buffer_data, GL_STATIC_DRAW); // Copy the vertices into VBO
+    glBufferData (GL_ARRAY_BUFFER, numVertices*sizeof(Vertex), vertices, GL_STATIC_DRAW); // Copy the vertices into VBO
     glVertexAttribPointer(
-            0,                  // attribute 0. Vertices
-            3,                  // size (x,y,z)
+            0,                  // attribute 0. Position
+            2,                  // size (x,y)
             GL_FLOAT,           // type
             GL_FALSE,           // normalized?
-            0,                  // stride
-            (void*)0            // array buffer offset
+            sizeof(Vertex),     // stride
+            (void*)offsetof(Vertex,x) // array buffer offset
             );
-
-    glBindBuffer (GL_ARRAY_BUFFER, vao->ColorBuffer); // Bind the VBO colors
-    glBufferData (GL_ARRAY_BUFFER, 3*numVertices*sizeof(GLfloat), color_buffer_data, GL_STATIC_DRAW);  // Copy the vertex colors
     glVertexAttribPointer(
-            1,                  // attribute 1. Color
-            3,                  // size (r,g,b)
-            GL_FLOAT,           // type
-            GL_FALSE,           // normalized?
-            0,                  // stride
-            (void*)0            // array buffer offset
+            1,                  // attribute 1. Corner weights
+            4,                  // size (one per corner color)
+            GL_UNSIGNED_BYTE,   // type
+            GL_TRUE,            // normalized? (0 to 1)
+            sizeof(Vertex),     // stride
+            (void*)offsetof(Vertex,corner) // array buffer offset
             );
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+
+    // Attributes 2 to 7 advance once per sprite instead of once per vertex, the buffer is filled by draw3DObject
+    glBindBuffer (GL_ARRAY_BUFFER, vao->InstanceBuffer); // Bind the VBO sprites
+    GLsizei stride = sizeof(SpriteInstance);
+    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(SpriteInstance,place));
+    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(SpriteInstance,scale));
+    for (int c=0; c<4; c++)
+        glVertexAttribPointer(4+c, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, (void*)(offsetof(SpriteInstance,colors)+c*4));
+    for (int a=2; a<8; a++) {
+        glEnableVertexAttribArray(a);
+        glVertexAttribDivisor(a, 1);
+    }
 
     return vao;
 }
 
-/* Generate VAO, VBOs and return VAO handle - Common Color for all vertices */
-struct VAO* create3DObject (GLenum primitive_mode, int numVertices, GLfloat* vertex_buffer_data, GLfloat red, GLfloat green, GLfloat blue, GLenum fill_mode=GL_FILL)
+/* Generate VAO, VBOs and return VAO handle - x,y,z of every vertex, all of them take the first color */
+struct VAO* create3DObject (GLenum primitive_mode, int numVertices, const GLfloat* vertex_buffer_data, GLenum fill_mode=GL_FILL)
 {
-    GLfloat* color_buffer_data = new GLfloat [3*numVertices];
+    vector<Vertex> vertices(numVertices);
     for (int i=0; i<numVertices; i++) {
-        color_buffer_data [3*i] = red;
-        color_buffer_data [3*i + 1] = green;
-        color_buffer_data [3*i + 2] = blue;
+        Vertex vertex = {vertex_buffer_data[3*i], vertex_buffer_data[3*i+1], {255,0,0,0}};
+        vertices[i] = vertex;
     }
 
-    return create3DObject(primitive_mode, numVertices, vertex_buffer_data, color_buffer_data, fill_mode);
+    return create3DObject(primitive_mode, numVertices, &vertices[0], fill_mode);
 }
 
-/* Render the VBOs handled by VAO */
+/* Render the VBOs handled by VAO, once for every sprite queued on it */
 void draw3DObject (struct VAO* vao)
 {
+    int count = vao->Instances.size();
+    if(count==0)
+        return;
+
     // Change the Fill Mode for this object
     glPolygonMode (GL_FRONT_AND_BACK, vao->FillMode);
 
     // Bind the VAO to use
     glBindVertexArray (vao->VertexArrayID);
 
-    // Enable Vertex Attribute 0 - 3d Vertices
-    glEnableVertexAttribArray(0);
-    // Bind the VBO to use
-    glBindBuffer(GL_ARRAY_BUFFER, vao->VertexBuffer);
-
-    // Enable Vertex Attribute 1 - Color
-    glEnableVertexAttribArray(1);
-    // Bind the VBO to use
-    glBindBuffer(GL_ARRAY_BUFFER, vao->ColorBuffer);
+    // Copy the sprites, into a new buffer so the driver doesn't wait for the last frame to be done with the old one
+    glBindBuffer (GL_ARRAY_BUFFER, vao->InstanceBuffer);
+    if(count>vao->InstanceCapacity)
+        vao->InstanceCapacity = max(count,2*vao->InstanceCapacity);
+    glBufferData (GL_ARRAY_BUFFER, vao->InstanceCapacity*sizeof(SpriteInstance), NULL, GL_STREAM_DRAW);
+    glBufferSubData (GL_ARRAY_BUFFER, 0, count*sizeof(SpriteInstance), &vao->Instances[0]);
 
     // Draw the geometry !
-    glDrawArrays(vao->PrimitiveMode, 0, vao->NumVertices); // Starting from vertex 0; 3 vertices total -> 1 triangle
+    glDrawArraysInstanced(vao->PrimitiveMode, 0, vao->NumVertices, count); // Starting from vertex 0, once per sprite
+    vao->Instances.clear();
+}
+
+/* Mesh cache - Geometry shared by the sprites */
+//Sprites of the same shape share one mesh: a 1x1 square for all the rectangles and a circle of radius 1 for every
+//number of parts. drawSprite scales it to the sprite and colors it, the vertices only hold how much of each of the
+//4 corner colors of the sprite they take (See Sample_GL.vert). Nothing is ever removed, so the meshes are created
+//once at startup and sprites rebuilt while playing (like the power bar) don't create GL objects.
+map <string, VAO*> mesh_cache; //By shape, tessellation and fill
+
+VAO* rectangleMesh ()
+{
+    VAO* &mesh = mesh_cache["rectangle"];
+    if(mesh==NULL){
+        // GL3 accepts only Triangles. Quads are not supported
+        Vertex vertices [] = {
+            {-0.5,-0.5, {255,0,0,0}}, // vertex 1, color 1
+            {-0.5,0.5, {0,255,0,0}}, // vertex 2, color 2
+            {0.5,0.5, {0,0,255,0}}, // vertex 3, color 3
+
+            {0.5,0.5, {0,0,255,0}}, // vertex 3, color 3
+            {0.5,-0.5, {0,0,0,255}}, // vertex 4, color 4
+            {-0.5,-0.5, {255,0,0,0}}  // vertex 1, color 1
+        };
+        mesh = create3DObject(GL_TRIANGLES, 6, vertices, GL_FILL);
+    }
+    return mesh;
+}
+
+VAO* circleMesh (int parts, int fill)
+{
+    VAO* &mesh = mesh_cache["circle"+to_string(parts)+(fill==1 ? "" : "line")];
+    if(mesh==NULL){
+        vector<GLfloat> vertex_buffer_data(parts*9);
+        float angle=(2*M_PI/parts);
+        float current_angle = 0;
+        for(int i=0;i<parts;i++){
+            vertex_buffer_data[i*9]=0;
+            vertex_buffer_data[i*9+1]=0;
+            vertex_buffer_data[i*9+2]=0;
+            vertex_buffer_data[i*9+3]=cos(current_angle);
+            vertex_buffer_data[i*9+4]=sin(current_angle);
+            vertex_buffer_data[i*9+5]=0;
+            vertex_buffer_data[i*9+6]=cos(current_angle+angle);
+            vertex_buffer_data[i*9+7]=sin(current_angle+angle);
+            vertex_buffer_data[i*9+8]=0;
+            current_angle+=angle;
+        }
+        mesh = create3DObject(GL_TRIANGLES, parts*3, &vertex_buffer_data[0], fill==1 ? GL_FILL : GL_LINE);
+    }
+    return mesh;
+}
+
+//Triangles are only shared when they have the same corners
+VAO* triangleMesh (GLfloat vertex_buffer_data[9], int fill)
+{
+    string key="triangle";
+    for(int i=0;i<9;i++)
+        key+=" "+to_string(vertex_buffer_data[i]);
+    VAO* &mesh = mesh_cache[key+(fill==1 ? "" : " line")];
+    if(mesh==NULL)
+        mesh = create3DObject(GL_TRIANGLES, 3, vertex_buffer_data, fill==1 ? GL_FILL : GL_LINE);
+    return mesh;
+}
+
+//Change the size of a sprite, only its scale changes as the mesh is shared
+void resizeSprite (Sprite &sprite, float width, float height)
+{
+    sprite.width=width;
+    sprite.height=height;
+    if(sprite.object==rectangleMesh()){
+        sprite.radius=(sqrt(height*height+width*width))/2;
+        sprite.scale_x=width;
+        sprite.scale_y=height;
+    }
+    else{ //A circle
+        sprite.radius=width/2;
+        sprite.scale_x=sprite.radius;
+        sprite.scale_y=sprite.radius;
+    }
+}
+
+/* Render queue */
+//Everything drawn in a frame is submitted with a sort key: its layer, its depth in the layer, its mesh and its program.
+//flushRenderQueue radix sorts the keys once per frame, so the draw order only depends on the keys and not on the
+//order things were submitted in (equal keys keep it). Each sprite is then placed a little in front of the ones before
+//it, so the depth test keeps that order however the meshes are drawn, and every mesh is drawn with one instanced draw.
+#define LAYER_BACKGROUND 0 //Sky, clouds and the power bar
+#define LAYER_TRAJECTORY 1
+#define LAYER_PICKUPS 2
+#define LAYER_BODIES 3
+#define LAYER_PIGS 4 //Faces over the pig bodies
+#define LAYER_DEBRIS 5
+#define LAYER_CANNON 6
+#define LAYER_POPUP 7 //Backgrounds of the score popup and the end of the game
+#define LAYER_TEXT 8
+#define LAYER_STATS 9
+
+#define PROGRAM_SPRITES 0
+#define PROGRAM_DEBRIS 1
+
+#define SPRITE_DEPTH_FARTHEST -400.0f //z of the first sprite of a frame, the camera sees up to -499
+#define SPRITE_DEPTH_STEP 0.001f //Between two sprites, well above what the depth buffer can tell apart
+
+//Something to draw, a sprite or (without a mesh) all the debris
+struct RenderItem {
+    VAO* mesh;
+    SpriteInstance instance;
+};
+typedef struct RenderItem RenderItem;
+
+vector<unsigned long long> render_keys;
+vector<RenderItem> render_items;
+vector<unsigned long long> sorted_keys, keys_scratch;
+vector<unsigned int> render_order, order_scratch; //Items in the order they are drawn
+
+void drawDebris(glm::mat4 VP, float depth);
+
+//Layer in the top 8 bits, then 24 bits of depth, 16 of mesh and 8 of program
+unsigned long long renderKey (int layer, int depth, int mesh, int program)
+{
+    return ((unsigned long long)layer<<56) | ((unsigned long long)(depth&0xffffff)<<32) | ((unsigned long long)(mesh&0xffff)<<16) | ((unsigned long long)(program&0xff)<<8);
+}
+
+//Submit a sprite placed by model (moved and turned only), its mesh is scaled to its size and takes its colors
+void drawSprite (const Sprite &sprite, const glm::mat4 &model, int layer, int depth)
+{
+    RenderItem item;
+    item.mesh = sprite.object;
+    SpriteInstance &instance = item.instance;
+    instance.place[0] = model[3][0];
+    instance.place[1] = model[3][1];
+    instance.place[2] = model[0][0]; //Cosine
+    instance.place[3] = model[0][1]; //Sine
+    instance.scale[0] = sprite.scale_x;
+    instance.scale[1] = sprite.scale_y;
+    instance.scale[2] = 0; //Set once the order is known
+    for(int c=0;c<4;c++){
+        instance.colors[c][0] = sprite.colors[c].r*255+0.5f;
+        instance.colors[c][1] = sprite.colors[c].g*255+0.5f;
+        instance.colors[c][2] = sprite.colors[c].b*255+0.5f;
+        instance.colors[c][3] = 255;
+    }
+    render_keys.push_back(renderKey(layer,depth,item.mesh->MeshID,PROGRAM_SPRITES));
+    render_items.push_back(item);
+}
+
+//Submit the debris, all the fragments are drawn together
+void submitDebris ()
+{
+    RenderItem item = {};
+    render_keys.push_back(renderKey(LAYER_DEBRIS,0,0,PROGRAM_DEBRIS));
+    render_items.push_back(item);
+}
+
+//Least significant byte first, skipping the bytes all the keys share
+void sortRenderQueue ()
+{
+    int n = render_keys.size();
+    sorted_keys = render_keys;
+    keys_scratch.resize(n);
+    render_order.resize(n);
+    order_scratch.resize(n);
+    for(int i=0;i<n;i++)
+        render_order[i]=i;
+    for(int shift=0;shift<64 && n>0;shift+=8){
+        int start[256] = {};
+        for(int i=0;i<n;i++)
+            start[(sorted_keys[i]>>shift)&255]++;
+        if(start[(sorted_keys[0]>>shift)&255]==n)
+            continue;
+        int offset=0;
+        for(int d=0;d<256;d++){
+            int count=start[d];
+            start[d]=offset;
+            offset+=count;
+        }
+        for(int i=0;i<n;i++){
+            int slot = start[(sorted_keys[i]>>shift)&255]++;
+            keys_scratch[slot]=sorted_keys[i];
+            order_scratch[slot]=render_order[i];
+        }
+        sorted_keys.swap(keys_scratch);
+        render_order.swap(order_scratch);
+    }
+}
+
+//Draw everything submitted this frame
+void flushRenderQueue (glm::mat4 VP)
+{
+    sortRenderQueue();
+    vector<VAO*> meshes; //In the order they first appear
+    float debris_depth = 0;
+    int debris_submitted = 0;
+    for(int i=0;i<render_order.size();i++){
+        RenderItem &item = render_items[render_order[i]];
+        float depth = SPRITE_DEPTH_FARTHEST + i*SPRITE_DEPTH_STEP;
+        if(item.mesh==NULL){
+            debris_depth = depth;
+            debris_submitted = 1;
+            continue;
+        }
+        if(item.mesh->Instances.empty())
+            meshes.push_back(item.mesh);
+        item.instance.scale[2] = depth;
+        item.mesh->Instances.push_back(item.instance);
+    }
+
+    glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &VP[0][0]);
+    for(int i=0;i<meshes.size();i++)
+        draw3DObject(meshes[i]);
+    if(debris_submitted)
+        drawDebris(VP, debris_depth);
+    render_keys.clear();
+    render_items.clear();
+}
+
+/* Debris - Fragments of destroyed bodies */
+//A fixed pool of fragments stored as a structure of arrays, so they are moved 4 at a time and spawning never
+//allocates. The live ones are packed at the front, a burst that doesn't fit anymore is cut short.
+//All of them are drawn with one instanced draw of a unit square (See Debris.vert), into an instance buffer that is
+//allocated once and refilled every frame.
+#define DEBRIS_CAPACITY 8192 //Multiple of 4
+#define DEBRIS_PER_BODY 24 //Fragments of a destroyed body
+#define DEBRIS_LIFE 60 //Longest a fragment lasts, in 1/60ths of a second
+#define DEBRIS_GRAVITY 0.5f //Speeds are in units per 1/60th of a second, like the bodies
+
+struct DebrisPool {
+    alignas(16) float x[DEBRIS_CAPACITY];
+    alignas(16) float y[DEBRIS_CAPACITY];
+    alignas(16) float x_speed[DEBRIS_CAPACITY];
+    alignas(16) float y_speed[DEBRIS_CAPACITY];
+    alignas(16) float angle[DEBRIS_CAPACITY]; //Radians
+    alignas(16) float spin[DEBRIS_CAPACITY];
+    alignas(16) float life[DEBRIS_CAPACITY]; //Left, the fragment shrinks with it
+    float size[DEBRIS_CAPACITY];
+    COLOR color[DEBRIS_CAPACITY];
+    int count;
+};
+typedef struct DebrisPool DebrisPool;
+
+DebrisPool debris;
+GLfloat debris_instances[DEBRIS_CAPACITY*8]; //x,y,angle,size and r,g,b,life (0 to 1) of every live fragment
+GLuint debris_programID, debris_MatrixID, debris_DepthID;
+GLuint debris_vao, debris_instance_buffer;
+unsigned debris_random=1;
+
+float debrisRandom(){ //0 to 1
+    debris_random^=debris_random<<13;
+    debris_random^=debris_random>>17;
+    debris_random^=debris_random<<5;
+    return (debris_random&0xffffff)/(float)0x1000000;
+}
+
+//Burst of fragments from a body, (x,y) is its centre
+void spawnDebris(float x, float y, float width, float height, const COLOR color[4]){
+    int i;
+    for(i=0;i<DEBRIS_PER_BODY && debris.count<DEBRIS_CAPACITY;i++){
+        int d=debris.count++;
+        debris.x[d]=x+(debrisRandom()-0.5f)*width;
+        debris.y[d]=y+(debrisRandom()-0.5f)*height;
+        debris.x_speed[d]=(debris.x[d]-x)/width*8+(debrisRandom()-0.5f)*2; //Away from the middle
+        debris.y_speed[d]=2+debrisRandom()*6;
+        debris.angle[d]=debrisRandom()*2*M_PI;
+        debris.spin[d]=(debrisRandom()-0.5f)*0.6f;
+        debris.life[d]=DEBRIS_LIFE*(0.5f+0.5f*debrisRandom());
+        debris.size[d]=min(width,height)*(0.15f+0.2f*debrisRandom());
+        debris.color[d]=color[i%4];
+    }
+}
+
+void moveDebris(int to, int from){
+    debris.x[to]=debris.x[from];
+    debris.y[to]=debris.y[from];
+    debris.x_speed[to]=debris.x_speed[from];
+    debris.y_speed[to]=debris.y_speed[from];
+    debris.angle[to]=debris.angle[from];
+    debris.spin[to]=debris.spin[from];
+    debris.life[to]=debris.life[from];
+    debris.size[to]=debris.size[from];
+    debris.color[to]=debris.color[from];
+}
+
+//Move the fragments by dt (in 1/60ths of a second) and drop the ones that ran out of life
+void stepDebris(float dt){
+    int i=0;
+#if defined(__SSE__)
+    __m128 step=_mm_set1_ps(dt), fall=_mm_set1_ps(DEBRIS_GRAVITY*dt);
+    for(;i<debris.count;i+=4){ //Up to 3 unused fragments past count are moved too, the capacity is a multiple of 4
+        __m128 x_speed=_mm_load_ps(&debris.x_speed[i]);
+        __m128 y_speed=_mm_sub_ps(_mm_load_ps(&debris.y_speed[i]),fall);
+        _mm_store_ps(&debris.y_speed[i],y_speed);
+        _mm_store_ps(&debris.x[i],_mm_add_ps(_mm_load_ps(&debris.x[i]),_mm_mul_ps(x_speed,step)));
+        _mm_store_ps(&debris.y[i],_mm_add_ps(_mm_load_ps(&debris.y[i]),_mm_mul_ps(y_speed,step)));
+        _mm_store_ps(&debris.angle[i],_mm_add_ps(_mm_load_ps(&debris.angle[i]),_mm_mul_ps(_mm_load_ps(&debris.spin[i]),step)));
+        _mm_store_ps(&debris.life[i],_mm_sub_ps(_mm_load_ps(&debris.life[i]),step));
+    }
+#else
+    for(;i<debris.count;i++){
+        debris.y_speed[i]-=DEBRIS_GRAVITY*dt;
+        debris.x[i]+=debris.x_speed[i]*dt;
+        debris.y[i]+=debris.y_speed[i]*dt;
+        debris.angle[i]+=debris.spin[i]*dt;
+        debris.life[i]-=dt;
+    }
+#endif
+    for(i=debris.count-1;i>=0;i--){ //The last live fragment takes the place of an expired one
+        if(debris.life[i]<=0){
+            debris.count--;
+            moveDebris(i,debris.count);
+        }
+    }
+}
+
+void createDebrisBuffers(){
+    glGenVertexArrays(1, &debris_vao);
+    glGenBuffers (1, &debris_instance_buffer);
+    glBindVertexArray (debris_vao);
+    glBindBuffer (GL_ARRAY_BUFFER, rectangleMesh()->VertexBuffer); //The unit square of the rectangles
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex,x));
+    glEnableVertexAttribArray(0);
+    //Attributes 2 and 3 advance once per fragment instead of once per vertex
+    glBindBuffer (GL_ARRAY_BUFFER, debris_instance_buffer);
+    glBufferData (GL_ARRAY_BUFFER, sizeof(debris_instances), NULL, GL_STREAM_DRAW);
+    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, 8*sizeof(GLfloat), (void*)0);
+    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, 8*sizeof(GLfloat), (void*)(4*sizeof(GLfloat)));
+    glEnableVertexAttribArray(2);
+    glEnableVertexAttribArray(3);
+    glVertexAttribDivisor(2, 1);
+    glVertexAttribDivisor(3, 1);
+}
+
+void drawDebris(glm::mat4 VP, float depth){
+    if(debris.count==0)
+        return;
+    int i;
+    for(i=0;i<debris.count;i++){
+        GLfloat *instance = &debris_instances[8*i];
+        instance[0]=debris.x[i];
+        instance[1]=debris.y[i];
+        instance[2]=debris.angle[i];
+        instance[3]=debris.size[i];
+        instance[4]=debris.color[i].r;
+        instance[5]=debris.color[i].g;
+        instance[6]=debris.color[i].b;
+        instance[7]=min(debris.life[i]/(DEBRIS_LIFE/2.0f),1.0f);
+    }
+    glUseProgram (debris_programID);
+    glUniformMatrix4fv(debris_MatrixID, 1, GL_FALSE, &VP[0][0]);
+    glUniform1f(debris_DepthID, depth);
+    glPolygonMode (GL_FRONT_AND_BACK, GL_FILL);
+    glBindVertexArray (debris_vao);
+    glBindBuffer (GL_ARRAY_BUFFER, debris_instance_buffer);
+    glBufferData (GL_ARRAY_BUFFER, sizeof(debris_instances), NULL, GL_STREAM_DRAW); //Orphan the last frame's fragments instead of waiting for the GPU to be done with them
+    glBufferSubData (GL_ARRAY_BUFFER, 0, 8*debris.count*sizeof(GLfloat), debris_instances);
+    glDrawArraysInstanced(GL_TRIANGLES, 0, 6, debris.count);
+    glUseProgram (programID);
 }
 
 /**************************
  * Customizable functions *
  **************************/
 
-int player_status=0; //0 is ready to play, 1 is not ready yet
-
 double launch_power=0;
 double launch_angle=0;
 int keyboard_pressed=0;
 
+void check_pan();
+
 void mousescroll(GLFWwindow* window, double xoffset, double yoffset)
 {
     if (yoffset==-1) { 
@@ -308,33 +683,26 @@ void mousescroll(GLFWwindow* window, double xoffset, double yoffset)
     else if(yoffset==1){
         zoom_camera *= 1.1; //make it bigger than current size
     }
-    if (zoom_camera<=1) {
-        zoom_camera = 1;
+    if (zoom_camera<=zoom_min) {
+        zoom_camera = zoom_min;
     }
     if (zoom_camera>=4) {
         zoom_camera=4;
     }
-    if(x_change-400.0f/zoom_camera<-400)
-        x_change=-400+400.0f/zoom_camera;
-    else if(x_change+400.0f/zoom_camera>400)
-        x_change=400-400.0f/zoom_camera;
-    if(y_change-300.0f/zoom_camera<-300)
-        y_change=-300+300.0f/zoom_camera;
-    else if(y_change+300.0f/zoom_camera>300)
-        y_change=300-300.0f/zoom_camera;
+    check_pan();
     Matrices.projection = glm::ortho((float)(-400.0f/zoom_camera+x_change), (float)(400.0f/zoom_camera+x_change), (float)(-300.0f/zoom_camera+y_change), (float)(300.0f/zoom_camera+y_change), 0.1f, 500.0f);
 }
 
 //Ensure the panning does not go out of the map
 void check_pan(){
-    if(x_change-400.0f/zoom_camera<-400)
-        x_change=-400+400.0f/zoom_camera;
-    else if(x_change+400.0f/zoom_camera>400)
-        x_change=400-400.0f/zoom_camera;
-    if(y_change-300.0f/zoom_camera<-300)
-        y_change=-300+300.0f/zoom_camera;
-    else if(y_change+300.0f/zoom_camera>300)
-        y_change=300-300.0f/zoom_camera;
+    if(x_change-400.0f/zoom_camera<map_left)
+        x_change=map_left+400.0f/zoom_camera;
+    else if(x_change+400.0f/zoom_camera>map_right)
+        x_change=map_right-400.0f/zoom_camera;
+    if(y_change-300.0f/zoom_camera<map_bottom)
+        y_change=map_bottom+300.0f/zoom_camera;
+    else if(y_change+300.0f/zoom_camera>map_top)
+        y_change=map_top-300.0f/zoom_camera;
 }
 
 void initKeyboard(){
@@ -409,49 +777,25 @@ void keyboard (GLFWwindow* window, int key, int scancode, int action, int mods)
                 keyboard_pressed=0;
                 backgroundObjects["cannonpowerdisplay"].status=0;
                 cannonObjects["cannonaim"].status=0;
-                if(player_status==0){
-                    player_status=1;
-                    if(objects["cannonball"].inAir == 0){
-                        objects["cannonball"].inAir = 1;
-                        objects["cannonball"].x = -315+cos(launch_angle*(M_PI/180))*cannonObjects["cannonrectangle"].width;
-                        objects["cannonball"].y = -210+sin(launch_angle*(M_PI/180))*cannonObjects["cannonrectangle"].width;
-                        //Set max jump speeds here (currently 300 and 300) (Adjust these as required)
-                        //Also adjust the sensitivity of the mouse drag as required
-                        objects["cannonball"].y_speed = min((abs(launch_power*10/89120)*sin(launch_angle*(M_PI/180))),30.0);
-                        objects["cannonball"].x_speed = min((abs(launch_power*10/89120)*cos(launch_angle*(M_PI/180))),30.0);
-                        for(map<string,Sprite>::iterator it=cannonObjects.begin();it!=cannonObjects.end();it++){
-                            string current = it->first; //The name of the current object
-                            cannonObjects[current].dx=16;
-                            cannonObjects[current].isMovingAnim=1;
-                        }
-                    }
-                }
+                fireCannon(launch_angle,launch_power);
                 break;
             case GLFW_KEY_C:
                 break;
             case GLFW_KEY_P:
+                show_physics_stats=1-show_physics_stats;
+                physics_timings=show_physics_stats;
                 break;
             case GLFW_KEY_X:
                 // do something ..
                 break;
             case GLFW_KEY_R:
-                objects["cannonball"].y=-240;
-                objects["cannonball"].x=-315;
-                objects["cannonball"].inAir=0;
-                for(map<string,Sprite>::iterator it=cannonObjects.begin();it!=cannonObjects.end();it++){
-                    string current = it->first; //The name of the current object
-                    if(cannonObjects[current].isMovingAnim==1){
-                        cannonObjects[current].x+=16-cannonObjects[current].dx;
-                        cannonObjects[current].isMovingAnim=0;
-                        cannonObjects[current].dx=0;
-                    }
-                    if(cannonObjects[current].isMovingAnim==2){
-                        cannonObjects[current].x+=cannonObjects[current].dx;
-                        cannonObjects[current].isMovingAnim=0;
-                        cannonObjects[current].dx=0;
-                    }
+                resetCannonball();
+                break;
+            case GLFW_KEY_U:
+                if(game_over!=1 && rewindShot()){
+                    debris.count=0;
+                    cout << "SHOT TAKEN BACK" << endl;
                 }
-                player_status=0;
                 break;
             default:
                 break;
@@ -493,29 +837,25 @@ void mouse_click(){
     backgroundObjects["cannonpowerdisplay"].status=1;
 }
 
+//Position and speed of a shot released with the cursor at (mouse_x,mouse_y)
+void mouseLaunch(double mouse_x, double mouse_y, double launch[4]){
+    float angle=cannonObjects["cannonrectangle"].angle*(M_PI/180.0);
+    launch[0]=-315+cos(angle)*cannonObjects["cannonrectangle"].width;
+    launch[1]=-210+sin(angle)*cannonObjects["cannonrectangle"].width;
+    //Adjust the sensitivity of the mouse drag as required
+    launch[2]=(mouse_x-77)/15+3.0;
+    launch[3]=(543-mouse_y)/15+3.0;
+}
+
 void mouse_release(GLFWwindow* window, int button){ 
     mouse_clicked=0;
     backgroundObjects["cannonpowerdisplay"].status=0;
     cannonObjects["cannonaim"].status=0;
-    if(player_status==0){
-        player_status=1;
-        glfwGetCursorPos(window,&mouse_x,&mouse_y);
-        if(objects["cannonball"].inAir == 0){
-            objects["cannonball"].inAir = 1;
-            float angle=cannonObjects["cannonrectangle"].angle*(M_PI/180.0);
-            //Adjust the sensitivity of the mouse drag as required
-            objects["cannonball"].x = -315+cos(angle)*cannonObjects["cannonrectangle"].width;
-            objects["cannonball"].y = -210+sin(angle)*cannonObjects["cannonrectangle"].width;
-            click_time=glfwGetTime();
-            objects["cannonball"].y_speed = min((543-mouse_y)/15+3.0,30.0);
-            objects["cannonball"].x_speed = min((mouse_x-77)/15+3.0,30.0);
-            for(map<string,Sprite>::iterator it=cannonObjects.begin();it!=cannonObjects.end();it++){
-                string current = it->first; //The name of the current object
-                cannonObjects[current].dx=16;
-                cannonObjects[current].isMovingAnim=1;
-            }
-        }
-    }
+    glfwGetCursorPos(window,&mouse_x,&mouse_y);
+    double launch[4];
+    mouseLaunch(mouse_x,mouse_y,launch);
+    if(launchCannonball(launch[0],launch[1],launch[2],launch[3]))
+        click_time=glfwGetTime();
 }
 
 /* Executed when a mouse button is pressed/released */
@@ -572,7 +912,55 @@ void reshapeWindow (GLFWwindow* window, int width, int height)
 
 
 // Creates the triangle object used in this sample code
-void createTriangle (string name, float weight, COLOR color, float x[], float y[], string component, int fill)
+//The sprites of a component, anything else goes with the objects
+map <string, Sprite> &componentSprites (string component)
+{
+    //All the different layers
+    if(component=="cannon")
+        return cannonObjects;
+    else if(component=="background")
+        return backgroundObjects;
+    else if(component=="pickup")
+        return pickupObjects;
+    else if(component=="pig")
+        return pigObjects;
+    else if(component=="stats")
+        return statsObjects;
+    else if(component=="char1")
+        return char1Objects;
+    else if(component=="char2")
+        return char2Objects;
+    else if(component=="char3")
+        return char3Objects;
+    else if(component=="char4")
+        return char4Objects;
+    else if(component=="charscore1")
+        return charscoreObjects1;
+    else if(component=="charscore2")
+        return charscoreObjects2;
+    else if(component=="charscore3")
+        return charscoreObjects3;
+    else if(component=="scorelabel")
+        return scoreLabelObjects;
+    else if(component=="endlabel")
+        return endLabelObjects;
+    else if(component=="timelabel")
+        return timerObjects;
+    else
+        return objects;
+}
+
+//Keep a sprite in its component, where it is drawn over the ones created before it. Creating it again (with the same
+//name) keeps its place.
+void storeSprite (Sprite &vishsprite, string component)
+{
+    map <string, Sprite> &sprites = componentSprites(component);
+    map <string, Sprite>::iterator it = sprites.find(vishsprite.name);
+    vishsprite.depth = it!=sprites.end() ? it->second.depth : sprites.size();
+    sprites[vishsprite.name]=vishsprite;
+}
+
+void createTriangle (string name, COLOR color, float x[], float y[], string component, int fill)
 {
     /* ONLY vertices between the bounds specified in glm::ortho will be visible on screen */
 
@@ -585,443 +973,75 @@ void createTriangle (string name, float weight, COLOR color, float x[], float y[
         x[2]-xc,y[2]-yc,0 // vertex 2
     };
 
-    GLfloat color_buffer_data [] = {
-        color.r,color.g,color.b, // color 1
-        color.r,color.g,color.b, // color 2
-        color.r,color.g,color.b // color 3
-    };
-
-    // create3DObject creates and returns a handle to a VAO that can be used later
-    VAO *triangle;
-    if(fill==1)
-        triangle=create3DObject(GL_TRIANGLES, 3, vertex_buffer_data, color_buffer_data, GL_FILL);
-    else
-        triangle=create3DObject(GL_TRIANGLES, 3, vertex_buffer_data, color_buffer_data, GL_LINE);
     Sprite vishsprite = {};
     vishsprite.color = color;
+    vishsprite.colors[0] = color;
     vishsprite.name = name;
-    vishsprite.object = triangle;
+    vishsprite.object = triangleMesh(vertex_buffer_data,fill);
+    vishsprite.scale_x=1;
+    vishsprite.scale_y=1;
     vishsprite.x=(x[0]+x[1]+x[2])/3; //Position of the sprite is the position of the centroid
     vishsprite.y=(y[0]+y[1]+y[2])/3;
     vishsprite.height=-1; //Height of the sprite is undefined
     vishsprite.width=-1; //Width of the sprite is undefined
     vishsprite.status=1;
-    vishsprite.inAir=0;
-    vishsprite.x_speed=0;
-    vishsprite.y_speed=0;
     vishsprite.radius=-1; //The bounding circle radius is not defined.
-    vishsprite.fixed=0;
-    vishsprite.friction=0.4;
-    vishsprite.health=100;
-    vishsprite.weight=weight;
-    if(component=="cannon")
-        cannonObjects[name]=vishsprite;
-    else if(component=="background")
-        backgroundObjects[name]=vishsprite;
-    else if(component=="goal")
-        goalObjects[name]=vishsprite;
-    else
-        objects[name]=vishsprite;
+    storeSprite(vishsprite,component);
 }
 
 // Creates the rectangle object used in this sample code
-void createRectangle (string name, float weight, COLOR colorA, COLOR colorB, COLOR colorC, COLOR colorD, float x, float y, float height, float width, string component)
+void createRectangle (string name, COLOR colorA, COLOR colorB, COLOR colorC, COLOR colorD, float x, float y, float height, float width, string component)
 {
-    // GL3 accepts only Triangles. Quads are not supported
-    float w=width/2,h=height/2;
-    GLfloat vertex_buffer_data [] = {
-        -w,-h,0, // vertex 1
-        -w,h,0, // vertex 2
-        w,h,0, // vertex 3
-
-        w,h,0, // vertex 3
-        w,-h,0, // vertex 4
-        -w,-h,0  // vertex 1
-    };
-
-    GLfloat color_buffer_data [] = {
-        colorA.r,colorA.g,colorA.b, // color 1
-        colorB.r,colorB.g,colorB.b, // color 2
-        colorC.r,colorC.g,colorC.b, // color 3
-
-        colorC.r,colorC.g,colorC.b, // color 4
-        colorD.r,colorD.g,colorD.b, // color 5
-        colorA.r,colorA.g,colorA.b // color 6
-    };
-
-    // create3DObject creates and returns a handle to a VAO that can be used later
-    VAO *rectangle = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
     Sprite vishsprite = {};
     vishsprite.color = colorA;
+    vishsprite.colors[0] = colorA;
+    vishsprite.colors[1] = colorB;
+    vishsprite.colors[2] = colorC;
+    vishsprite.colors[3] = colorD;
     vishsprite.name = name;
-    vishsprite.object = rectangle;
+    vishsprite.object = rectangleMesh();
+    vishsprite.scale_x=width;
+    vishsprite.scale_y=height;
     vishsprite.x=x;
     vishsprite.y=y;
     vishsprite.height=height;
     vishsprite.width=width;
     vishsprite.status=1;
-    vishsprite.inAir=0;
-    vishsprite.x_speed=0;
-    vishsprite.y_speed=0;
-    vishsprite.fixed=0;
     vishsprite.radius=(sqrt(height*height+width*width))/2;
-    vishsprite.friction=0.4;
-    vishsprite.health=100;
-    vishsprite.weight=weight;
-    //All the different layers
-    if(component=="cannon")
-        cannonObjects[name]=vishsprite;
-    else if(component=="background")
-        backgroundObjects[name]=vishsprite;
-    else if(component=="goal")
-        goalObjects[name]=vishsprite;
-    else if(component=="pig1")
-        pig1Objects[name]=vishsprite;
-    else if(component=="pig2")
-        pig2Objects[name]=vishsprite;
-    else if(component=="pig3")
-        pig3Objects[name]=vishsprite;
-    else if(component=="pig4")
-        pig4Objects[name]=vishsprite;
-    else if(component=="char1")
-        char1Objects[name]=vishsprite;
-    else if(component=="char2")
-        char2Objects[name]=vishsprite;
-    else if(component=="char3")
-        char3Objects[name]=vishsprite;
-    else if(component=="char4")
-        char4Objects[name]=vishsprite;
-    else if(component=="charscore1")
-        charscoreObjects1[name]=vishsprite;
-    else if(component=="charscore2")
-        charscoreObjects2[name]=vishsprite;
-    else if(component=="charscore3")
-        charscoreObjects3[name]=vishsprite;
-    else if(component=="scorelabel")
-        scoreLabelObjects[name]=vishsprite;
-    else if(component=="endlabel")
-        endLabelObjects[name]=vishsprite;
-    else if(component=="timelabel")
-        timerObjects[name]=vishsprite;
-    else
-        objects[name]=vishsprite;
+    storeSprite(vishsprite,component);
 }
 
-void createCircle (string name, float weight, COLOR color, float x, float y, float r, int NoOfParts, string component, int fill)
+void createCircle (string name, COLOR color, float x, float y, float r, int NoOfParts, string component, int fill)
 {
-    int parts = NoOfParts;
-    float radius = r;
-    GLfloat vertex_buffer_data[parts*9];
-    GLfloat color_buffer_data[parts*9];
-    int i,j;
-    float angle=(2*M_PI/parts);
-    float current_angle = 0;
-    for(i=0;i<parts;i++){
-        for(j=0;j<3;j++){
-            color_buffer_data[i*9+j*3]=color.r;
-            color_buffer_data[i*9+j*3+1]=color.g;
-            color_buffer_data[i*9+j*3+2]=color.b;
-        }
-        vertex_buffer_data[i*9]=0;
-        vertex_buffer_data[i*9+1]=0;
-        vertex_buffer_data[i*9+2]=0;
-        vertex_buffer_data[i*9+3]=radius*cos(current_angle);
-        vertex_buffer_data[i*9+4]=radius*sin(current_angle);
-        vertex_buffer_data[i*9+5]=0;
-        vertex_buffer_data[i*9+6]=radius*cos(current_angle+angle);
-        vertex_buffer_data[i*9+7]=radius*sin(current_angle+angle);
-        vertex_buffer_data[i*9+8]=0;
-        current_angle+=angle;
-    }
-    VAO* circle;
-    if(fill==1)
-        circle = create3DObject(GL_TRIANGLES, (parts*9)/3, vertex_buffer_data, color_buffer_data, GL_FILL);
-    else
-        circle = create3DObject(GL_TRIANGLES, (parts*9)/3, vertex_buffer_data, color_buffer_data, GL_LINE);
     Sprite vishsprite = {};
     vishsprite.color = color;
+    vishsprite.colors[0] = color;
     vishsprite.name = name;
-    vishsprite.object = circle;
+    vishsprite.object = circleMesh(NoOfParts,fill);
+    vishsprite.scale_x=r;
+    vishsprite.scale_y=r;
     vishsprite.x=x;
     vishsprite.y=y;
     vishsprite.height=2*r; //Height of the sprite is 2*r
     vishsprite.width=2*r; //Width of the sprite is 2*r
     vishsprite.status=1;
-    vishsprite.inAir=0;
-    vishsprite.x_speed=0;
-    vishsprite.y_speed=0;
     vishsprite.radius=r;
-    vishsprite.fixed=0;
-    vishsprite.friction=0.4;
-    vishsprite.health=100;
-    vishsprite.weight=weight;
-    if(component=="cannon")
-        cannonObjects[name]=vishsprite;
-    else if(component=="coin")
-        coins[name]=vishsprite;
-    else if(component=="background")
-        backgroundObjects[name]=vishsprite;
-    else if(component=="goal")
-        goalObjects[name]=vishsprite;
-    else if(component=="pig1")
-        pig1Objects[name]=vishsprite;
-    else if(component=="pig2")
-        pig2Objects[name]=vishsprite;
-    else if(component=="pig3")
-        pig3Objects[name]=vishsprite;
-    else if(component=="pig4")
-        pig4Objects[name]=vishsprite;
+    storeSprite(vishsprite,component);
+}
+
+//Geometry of a body or pickup of the world
+void createShape (const BodyShape &shape, float x, float y, float height, string component)
+{
+    if(shape.type==SHAPE_CIRCLE)
+        createCircle(shape.name,shape.color[0],x,y,shape.width/2,shape.parts,component,1);
     else
-        objects[name]=vishsprite;
+        createRectangle(shape.name,shape.color[0],shape.color[1],shape.color[2],shape.color[3],x,y,height,shape.width,component);
 }
 
 float camera_rotation_angle = 90;
 float rectangle_rotation = 0;
 float triangle_rotation = 0;
 
-int checkCollisionRight(Sprite col_object, Sprite my_object){
-    if(col_object.x>my_object.x && col_object.y+col_object.height/2>my_object.y-my_object.height/2 && col_object.y-col_object.height/2<my_object.y+my_object.height/2 && col_object.x-col_object.width/2<my_object.x+my_object.width/2 && col_object.x+col_object.width/2>my_object.x-my_object.width/2){
-        return 1;
-    }
-    return 0;
-}
-
-int checkCollisionLeft(Sprite col_object, Sprite my_object){
-    if(col_object.x<my_object.x && col_object.y+col_object.height/2>my_object.y-my_object.height/2 && col_object.y-col_object.height/2<my_object.y+my_object.height/2 && col_object.x+col_object.width/2>my_object.x-my_object.width/2 && col_object.x-col_object.width/2<my_object.x+my_object.width/2){
-        return 1;
-    }
-    return 0;
-}
-
-int checkCollisionTop(Sprite col_object, Sprite my_object){
-    if(col_object.y>my_object.y && col_object.x+col_object.width/2>my_object.x-my_object.width/2 && col_object.x-col_object.width/2<my_object.x+my_object.width/2 && col_object.y-col_object.height/2<my_object.y+my_object.height/2 && col_object.y+col_object.height/2>my_object.y-my_object.height/2){
-        return 1;
-    }
-    return 0;
-}
-
-int checkCollisionBottom(Sprite col_object, Sprite my_object){
-    if(col_object.y<my_object.y && col_object.x+col_object.width/2>my_object.x-my_object.width/2 && col_object.x-col_object.width/2<my_object.x+my_object.width/2 && col_object.y+col_object.height/2>my_object.y-my_object.height/2 && col_object.y-col_object.height/2<my_object.y+my_object.height/2){
-        return 1;
-    }
-    return 0;
-}
-
-
-//Check collisions between rectangles only
-//Bounding boxes collision
-//Best Method
-int checkCollision(string name, float dx, float dy){
-    int any_collide=0;
-    if(name=="cannonball"){
-        if(checkCollisionBottom(objects["springbase2"],objects["cannonball"])){
-            if(objects["springbase2"].isMovingAnim==0){
-                objects["springbase2"].isMovingAnim=1;
-                objects["springbase2"].dy=15;
-                objects["springbase3"].isMovingAnim=1;
-                objects["springbase3"].dy=15;
-            } 
-        }
-        for(map<string,Sprite>::iterator it2=coins.begin();it2!=coins.end();it2++){
-            Sprite col_object=coins[it2->first];
-            Sprite my_object=objects["cannonball"];
-            if(col_object.status==0)
-                continue;
-            if((dx>0 && checkCollisionRight(col_object,my_object)) || (dx<0 && checkCollisionLeft(col_object,my_object)) || (dy>0 && checkCollisionTop(col_object,my_object)) || (dy<0 && checkCollisionBottom(col_object,my_object))){
-                coins[it2->first].status=0;
-                cout <<" COIN " << endl;
-                scoreDrawTimer=50;
-                player_score+=100;
-                backgroundObjects["scorebackground"].status=1;
-                backgroundObjects["scorebackground"].x=it2->second.x+5;
-                backgroundObjects["scorebackground"].y=it2->second.y+it2->second.height/2+15;
-                characterValues[4]='1';
-                characterValues[5]='0';
-                characterValues[6]='0';
-                characterPosX[4]=it2->second.x-20;
-                characterPosY[4]=it2->second.y+it2->second.height/2+15;
-                characterPosX[5]=it2->second.x;
-                characterPosY[5]=it2->second.y+it2->second.height/2+15;
-                characterPosX[6]=it2->second.x+20;
-                characterPosY[6]=it2->second.y+it2->second.height/2+15;
-            }
-        }
-        for(map<string,Sprite>::iterator it2=goalObjects.begin();it2!=goalObjects.end();it2++){
-            Sprite col_object=goalObjects[it2->first];
-            Sprite my_object=objects["cannonball"];
-            if(col_object.status==0)
-                continue;
-            if((dx>0 && checkCollisionRight(col_object,my_object)) || (dx<0 && checkCollisionLeft(col_object,my_object)) || (dy>0 && checkCollisionTop(col_object,my_object)) || (dy<0 && checkCollisionBottom(col_object,my_object))){
-                goalObjects[it2->first].status=0;
-                cout <<" GOAL OBTAINED" << endl;
-                scoreDrawTimer=50;
-                player_score+=200;
-                backgroundObjects["scorebackground"].status=1;
-                backgroundObjects["scorebackground"].x=it2->second.x;
-                backgroundObjects["scorebackground"].y=it2->second.y+it2->second.height/2+15;
-                characterValues[4]='2';
-                characterValues[5]='0';
-                characterValues[6]='0';
-                characterPosX[4]=it2->second.x-20;
-                characterPosY[4]=it2->second.y+it2->second.height/2+15;
-                characterPosX[5]=it2->second.x;
-                characterPosY[5]=it2->second.y+it2->second.height/2+15;
-                characterPosX[6]=it2->second.x+20;
-                characterPosY[6]=it2->second.y+it2->second.height/2+15;
-            }
-        }
-    }
-
-    for(map<string,Sprite>::iterator it2=objects.begin();it2!=objects.end();it2++){
-        int collide=0;
-        string colliding = it2->first;
-        Sprite col_object = it2->second;
-        Sprite my_object = objects[name];
-        if(col_object.status==0 || my_object.fixed==1)
-            continue;
-        float coef1; //'2*m1/(m1+m2)'
-        float coef2; //'2*m2/(m1+m2)'
-        float coef3; //'(m1-m2)/(m1+m2)'
-        if(my_object.weight+col_object.weight==0){
-            coef1=0;
-            coef2=0;
-            coef3=0;
-        }
-        else{
-            coef1=2*my_object.weight/(my_object.weight+col_object.weight);
-            coef2=2*col_object.weight/(my_object.weight+col_object.weight);
-            coef3=(my_object.weight-col_object.weight)/(my_object.weight+col_object.weight);
-        }
-        if(colliding!=name && col_object.height!=-1){ //Check collision only with circles and rectangles
-            if((dx>0 && checkCollisionRight(col_object,my_object)) || (dx<0 && checkCollisionLeft(col_object,my_object)) || (dy>0 && checkCollisionTop(col_object,my_object)) || (dy<=0 && checkCollisionBottom(col_object,my_object))){
-                collide=1;
-                /*float angle_from_x = atan2((col_object.y-my_object.y),(col_object.x-my_object.x));
-                  float my_speed_x = cos(angle_from_x)*my_object.x_speed+sin(angle_from_x)*my_object.y_speed;
-                  float my_speed_y = sin(angle_from_x)*my_object.x_speed+cos(angle_from_x)*my_object.y_speed;
-                  float col_speed_x = cos(angle_from_x)*col_object.x_speed+sin(angle_from_x)*col_object.y_speed;
-                  float col_speed_y = sin(angle_from_x)*col_object.x_speed+cos(angle_from_x)*col_object.y_speed;
-                  cout << angle_from_x*180/M_PI << endl;*/
-                if(col_object.fixed==0){
-                    col_object.x_speed=(coef1*my_object.x_speed-coef3*col_object.x_speed);
-                    col_object.y_speed=(coef1*my_object.y_speed-coef3*col_object.y_speed);
-                    //float col_x_speed_new=(coef1*my_speed_x-coef3*col_speed_x);
-                    //float col_y_speed_new=(coef1*my_speed_y-coef3*col_speed_y);
-                    //col_object.x_speed=cos(angle_from_x)*col_x_speed_new+sin(angle_from_x)*col_y_speed_new;
-                    //col_object.y_speed=cos(angle_from_x)*col_y_speed_new+sin(angle_from_x)*col_x_speed_new;
-                    col_object.inAir=1;
-                    if(col_object.isRotating==0 && name=="cannonball" && (abs(my_object.x_speed)>=15 || abs(my_object.y_speed)>=15)){
-                        if(my_object.x_speed>0 || my_object.y_speed>0){
-                            col_object.isRotating=1;
-                            col_object.direction=0;
-                            col_object.remAngle=90;
-                        }
-                        else{
-                            col_object.isRotating=1;
-                            col_object.direction=1;
-                            col_object.remAngle=90;
-                        }
-                    }
-                }
-                if(col_object.fixed==1){
-                    if((dx>0 && checkCollisionRight(col_object,my_object)) || (dx<0 && checkCollisionLeft(col_object,my_object))){
-                        my_object.x_speed*=-1/1.2;
-                    }
-                    if((dy>0 && checkCollisionTop(col_object,my_object)) || (dy<0 && checkCollisionBottom(col_object,my_object))){
-                        my_object.y_speed*=-1/1.2;
-                    }
-                }
-                else{
-                    if(name!="cannonball"){
-                        my_object.x_speed=(coef3*my_object.x_speed+coef2*col_object.x_speed); //Use elastic collision
-                        my_object.y_speed=(coef3*my_object.y_speed+coef2*col_object.y_speed); //Use elastic collision
-                    }
-                    //float my_x_speed_new=(coef3*my_speed_x+coef2*col_speed_x);
-                    //float my_y_speed_new=(coef3*my_speed_y+coef2*col_speed_y);
-                    //my_object.x_speed=cos(angle_from_x)*my_x_speed_new+sin(angle_from_x)*my_y_speed_new;
-                    //my_object.y_speed=cos(angle_from_x)*my_y_speed_new+sin(angle_from_x)*my_x_speed_new;
-                }
-                if(dx>0 && checkCollisionRight(col_object,my_object)){
-                    my_object.x=col_object.x-col_object.width/2-my_object.width/2;
-                }
-                else if(dx<0 && checkCollisionLeft(col_object,my_object)){
-                    my_object.x=col_object.x+col_object.width/2+my_object.width/2;
-                }
-                if(dy>0 && checkCollisionTop(col_object,my_object)){
-                    my_object.y=col_object.y-col_object.height/2-my_object.height/2;
-                }
-                else if(dy<=0 && checkCollisionBottom(col_object,my_object)){
-                    my_object.y=col_object.y+col_object.height/2+my_object.height/2;
-                }
-                if(dy!=0){
-                    if(abs(objects[name].y_speed)<=7.5 && abs(objects[name].x_speed)<=7.5){ 
-                        my_object.y_speed=0;
-                        my_object.x_speed=0;
-                        my_object.inAir=0;
-                        if(name=="cannonball" && player_reset_timer==0 && player_status==1){
-                            player_reset_timer=30;
-                        }
-                    }
-                }
-                my_object.x_speed/=(1+col_object.friction);
-                my_object.y_speed/=(1+col_object.friction);
-                col_object.x_speed/=(1+my_object.friction);
-                col_object.y_speed/=(1+my_object.friction);
-                collide=1;
-                if(abs(my_object.x_speed)<=2)
-                    my_object.x_speed=0;
-                if(abs(my_object.y_speed)<=2)
-                    my_object.y_speed=0;
-                if(abs(col_object.x_speed)<=2)
-                    col_object.x_speed=0;
-                if(abs(col_object.y_speed)<=2)
-                    col_object.y_speed=0;
-            }
-        }
-        if(collide==1 && name=="cannonball" && col_object.fixed==0 && (abs(my_object.x_speed)>=5 || abs(my_object.y_speed)>=5)){
-            any_collide=1;
-            col_object.health-=min(max(5.0,max(abs(my_object.x_speed),abs(my_object.y_speed))*2.5),10.0);
-            if(col_object.health<60){
-                if(colliding=="pig1")
-                    pig1Objects["pig1eye1hurt"].status=1;
-                else if(colliding=="pig2")
-                    pig2Objects["pig2eye2hurt"].status=1;
-                else if(colliding=="pig3")
-                    pig3Objects["pig3eye1hurt"].status=1;
-                else if(colliding=="pig4")
-                    pig4Objects["pig4eye1hurt"].status=1;
-            }
-            if(col_object.health<=0){
-                col_object.health=0;
-                player_score+=50;
-                characterValues[4]='.';
-                characterValues[5]='5';
-                characterValues[6]='0';
-                backgroundObjects["scorebackground"].status=1;
-                backgroundObjects["scorebackground"].x=col_object.x+10;
-                backgroundObjects["scorebackground"].y=col_object.y+col_object.height/2+15;
-                if(colliding=="pig1" || colliding=="pig2" || colliding=="pig3" || colliding=="pig4"){
-                    player_score+=50;
-                    backgroundObjects["scorebackground"].x=col_object.x+5;
-                    characterValues[4]='1';
-                    characterValues[5]='0';
-                    characterValues[6]='0';
-                }
-                scoreDrawTimer=50;
-                characterPosX[4]=col_object.x-20;
-                characterPosY[4]=col_object.y+col_object.height/2+15;
-                characterPosX[5]=col_object.x;
-                characterPosY[5]=col_object.y+col_object.height/2+15;
-                characterPosX[6]=col_object.x+20;
-                characterPosY[6]=col_object.y+col_object.height/2+15;
-                col_object.status=0;
-            }
-        }
-        objects[name]=my_object;
-        objects[colliding]=col_object;
-    }
-    return any_collide;
-}
-
 void setStrokes(char val, int charNo, map<string,Sprite> curChar){
     curChar["top"].status=0;
     curChar["bottom"].status=0;
@@ -1063,14 +1083,35 @@ void setStrokes(char val, int charNo, map<string,Sprite> curChar){
 }
 
 
-float old_time; // Time in seconds
-float cur_time; // Time in seconds
+double old_time; // Time in seconds
+double cur_time; // Time in seconds
 double mouse_pos_x, mouse_pos_y;
 double new_mouse_pos_x, new_mouse_pos_y;
 
+/* Fixed timestep physics */
+//main() collects the elapsed time and runs as many physics steps as fit (at most max_substeps per frame, the rest is
+//dropped so a long hitch slows the game down instead of freezing it). draw() then interpolates the bodies between
+//the last two steps, using the snapshot of the world taken after stepping.
+int max_substeps=8;
+double physics_accumulator=0; //Time not yet simulated, in physics steps
+float render_alpha=1; //How far the screen is between the last two physics steps (0 to 1)
+WorldSnapshot world;
+vector<Sprite*> bodySprites; //Geometry of each body, by handle
+vector<Sprite*> pickupSprites;
+vector<int> pig_bodies; //Handles of the pigs, their ears and eyes are drawn around them
+
+float interpolatedX(int body){
+    return world.prev_x[body]+(world.x[body]-world.prev_x[body])*render_alpha;
+}
+
+float interpolatedY(int body){
+    return world.prev_y[body]+(world.y[body]-world.prev_y[body])*render_alpha;
+}
+
 /* Render the scene with openGL */
 /* Edit this function according to your assignment */
-void draw (GLFWwindow* window)
+//alpha is how far the screen is between the last two physics steps (0 to 1)
+void draw (GLFWwindow* window, float alpha)
 {
     COLOR winbackground = {212/255.0,175/255.0,55/255.0};
     COLOR losebackground = {255/255.0,77/255.0,77/255.0};
@@ -1080,35 +1121,24 @@ void draw (GLFWwindow* window)
   
     game_timer=(int)(90-(glfwGetTime()-game_start_timer));
 
-    if(player_score>=1450){
+    if(world.score>=1450){
         game_over=1;
         endLabel_x=-150;
-        createRectangle("endgame",10000,winbackground,winbackground,winbackground,winbackground,0,0,200,600,"background");
+        createRectangle("endgame",winbackground,winbackground,winbackground,winbackground,0,0,200,600,"background");
         endLabel="YOU WIN";
     }
    
     if(glfwGetTime()-game_start_timer>=90){
         game_over=1;
-        createRectangle("endgame",10000,losebackground,losebackground,losebackground,losebackground,0,0,200,600,"background");
+        createRectangle("endgame",losebackground,losebackground,losebackground,losebackground,0,0,200,600,"background");
         endLabel="YOU LOSE";
     }
 
-    if(scoreDrawTimer>0){
-        scoreDrawTimer--;
-        if(scoreDrawTimer<=0){
-            scoreDrawTimer=-1;
-            backgroundObjects["scorebackground"].status=0;
-            characterValues[4]='.'; // '.' represents and empty character (It won't be drawn)
-            characterValues[5]='.'; // '.' represents and empty character (It won't be drawn)
-            characterValues[6]='.'; // '.' represents and empty character (It won't be drawn)
-        }
-    }
-
     characterValues[0]='.';
     characterValues[1]='.';
     characterValues[2]='.';
     characterValues[3]='.';
-    int cur_score = player_score;
+    int cur_score = world.score;
     int start=0;
     if(cur_score==0)
         characterValues[3]='0';
@@ -1117,6 +1147,15 @@ void draw (GLFWwindow* window)
         cur_score/=10;
         start++;
     }
+    //The points of the last score, above whatever gave them
+    for(int i=0;i<3;i++){
+        characterValues[4+i] = world.popup.timer>0 ? world.popup.text[i] : '.'; // '.' represents and empty character (It won't be drawn)
+        characterPosX[4+i]=world.popup.x+20*(i-1);
+        characterPosY[4+i]=world.popup.y;
+    }
+    backgroundObjects["scorebackground"].status = world.popup.timer>0;
+    backgroundObjects["scorebackground"].x=world.popup.background_x;
+    backgroundObjects["scorebackground"].y=world.popup.y;
     glfwGetCursorPos(window, &new_mouse_pos_x, &new_mouse_pos_y);
     if(right_mouse_clicked==1){
         x_change+=new_mouse_pos_x-mouse_pos_x;
@@ -1125,27 +1164,8 @@ void draw (GLFWwindow* window)
     }
     Matrices.projection = glm::ortho((float)(-400.0f/zoom_camera+x_change), (float)(400.0f/zoom_camera+x_change), (float)(-300.0f/zoom_camera+y_change), (float)(300.0f/zoom_camera+y_change), 0.1f, 500.0f);
     glfwGetCursorPos(window, &mouse_pos_x, &mouse_pos_y);
-    if(glfwGetTime()-click_time>=2){
-        objects["cannonball"].y=-240;
-        objects["cannonball"].x=-315;
-        objects["cannonball"].inAir=0;
-        for(map<string,Sprite>::iterator it=cannonObjects.begin();it!=cannonObjects.end();it++){
-            string current = it->first; //The name of the current object
-            if(cannonObjects[current].isMovingAnim==1){
-                cannonObjects[current].x+=16-cannonObjects[current].dx;
-                cannonObjects[current].isMovingAnim=0;
-                cannonObjects[current].dx=0;
-            }
-            if(cannonObjects[current].isMovingAnim==2){
-                cannonObjects[current].x+=cannonObjects[current].dx;
-                cannonObjects[current].isMovingAnim=0;
-                cannonObjects[current].dx=0;
-            }
-        }
-        player_status=0;
-    }
 
-    float time_delta = (cur_time-old_time)*60;
+    render_alpha = alpha;
 
     if(keyboard_pressed==1){ 
         cannonObjects["cannonrectangle"].angle=launch_angle;
@@ -1153,17 +1173,7 @@ void draw (GLFWwindow* window)
         double max_power=760*760+560*560;
         double width=min((power/max_power)*160,160.0);
         backgroundObjects["cannonpowerdisplay"].x=-350+width/2;
-        backgroundObjects["cannonpowerdisplay"].width=width;
-        COLOR my_color = backgroundObjects["cannonpowerdisplay"].color;
-        createRectangle("cannonpowerdisplay",10000,my_color,my_color,my_color,my_color,backgroundObjects["cannonpowerdisplay"].x,backgroundObjects["cannonpowerdisplay"].y,25,backgroundObjects["cannonpowerdisplay"].width,"background");
-        if(player_reset_timer>0){
-            player_reset_timer-=1;
-            if(player_reset_timer==0 && objects["cannonball"].inAir==0 && player_status==1){
-                player_status=0;
-                objects["cannonball"].y=-240;
-                objects["cannonball"].x=-315;
-            }
-        }
+        resizeSprite(backgroundObjects["cannonpowerdisplay"],width,25);
     }
     if(mouse_clicked==1) {
         float angle=0;
@@ -1181,17 +1191,20 @@ void draw (GLFWwindow* window)
         double max_power=760*760+560*560;
         double width=min((power/max_power)*160,160.0);
         backgroundObjects["cannonpowerdisplay"].x=-350+width/2;
-        backgroundObjects["cannonpowerdisplay"].width=width;
-        COLOR my_color = backgroundObjects["cannonpowerdisplay"].color;
-        createRectangle("cannonpowerdisplay",10000,my_color,my_color,my_color,my_color,backgroundObjects["cannonpowerdisplay"].x,backgroundObjects["cannonpowerdisplay"].y,25,backgroundObjects["cannonpowerdisplay"].width,"background");
-    }
-    if(player_reset_timer>0){
-        player_reset_timer-=1;
-        if(player_reset_timer==0 && objects["cannonball"].inAir==0 && player_status==1){
-            player_status=0;
-            objects["cannonball"].y=-240;
-            objects["cannonball"].x=-315;
+        resizeSprite(backgroundObjects["cannonpowerdisplay"],width,25);
+    }
+    //Predict where the shot being aimed would go
+    const TrajectoryPreview *preview=NULL;
+    if(keyboard_pressed==1 || mouse_clicked==1){
+        double launch[4];
+        if(keyboard_pressed==1)
+            cannonLaunch(launch_angle,launch_power,launch);
+        else{
+            double mouse_x_cur, mouse_y_cur;
+            glfwGetCursorPos(window,&mouse_x_cur,&mouse_y_cur);
+            mouseLaunch(mouse_x_cur,mouse_y_cur,launch);
         }
+        preview=&previewTrajectory(launch[0],launch[1],launch[2],launch[3],preview_budget_us);
     }
     // clear the color and depth in the frame buffer
     glClear (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -1221,7 +1234,6 @@ void draw (GLFWwindow* window)
         string current = it->first; //The name of the current object
         if(backgroundObjects[current].status==0)
             continue;
-        glm::mat4 MVP;  // MVP = Projection * View * Model
 
         Matrices.model = glm::mat4(1.0f);
 
@@ -1229,297 +1241,100 @@ void draw (GLFWwindow* window)
         glm::mat4 translateObject = glm::translate (glm::vec3(backgroundObjects[current].x, backgroundObjects[current].y, 0.0f)); // glTranslatef
         ObjectTransform=translateObject;
         Matrices.model *= ObjectTransform;
-        MVP = VP * Matrices.model; // MVP = p * V * M
         
-        glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-        draw3DObject(backgroundObjects[current].object);
+        drawSprite(backgroundObjects[current], Matrices.model, LAYER_BACKGROUND, backgroundObjects[current].depth);
         //glPopMatrix (); 
     }
 
-    //Draw the coins
-    for(map<string,Sprite>::iterator it=coins.begin();it!=coins.end();it++){
-        string current = it->first; //The name of the current object
-        if(coins[current].status==0)
-            continue;
-        glm::mat4 MVP;	// MVP = Projection * View * Model
-
-        Matrices.model = glm::mat4(1.0f);
-
-        /* Render your scene */
-        glm::mat4 ObjectTransform;
-        glm::mat4 translateObject = glm::translate (glm::vec3(coins[current].x, coins[current].y, 0.0f)); // glTranslatef
-        glm::mat4 rotateTriangle = glm::rotate((float)((0)*M_PI/180.0f), glm::vec3(0,1,0));  // rotate about vector (1,0,0)
-        coins[current].angle=(coins[current].angle+1.0*time_delta);
-        if(coins[current].angle>=360.0)
-            coins[current].angle=0.0;
-        ObjectTransform=translateObject*rotateTriangle;
-        Matrices.model *= ObjectTransform;
-        MVP = VP * Matrices.model; // MVP = p * V * M
-
-        glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-        draw3DObject(coins[current].object);
-        //glPopMatrix (); 
+    //Draw the dots of the predicted trajectory
+    if(preview!=NULL){
+        for(int i=1;i<preview->x.size();i++)
+            drawSprite(backgroundObjects["trajectorydot"], glm::translate (glm::vec3(preview->x[i], preview->y[i], 0.0f)), LAYER_TRAJECTORY, i);
     }
 
-    //Draw the goals
-    for(map<string,Sprite>::iterator it=goalObjects.begin();it!=goalObjects.end();it++){
-        string current = it->first; //The name of the current object
-        if(goalObjects[current].status==0)
+    //Draw the coins and goals
+    for(int i=0;i<pickupSprites.size();i++){
+        if(world.pickup_alive[i]==0)
             continue;
-        glm::mat4 MVP;  // MVP = Projection * View * Model
 
         Matrices.model = glm::mat4(1.0f);
 
         /* Render your scene */
         glm::mat4 ObjectTransform;
-        glm::mat4 translateObject = glm::translate (glm::vec3(goalObjects[current].x, goalObjects[current].y, 0.0f)); // glTranslatef
+        glm::mat4 translateObject = glm::translate (glm::vec3(pickupSprites[i]->x, pickupSprites[i]->y, 0.0f)); // glTranslatef
         ObjectTransform=translateObject;
         Matrices.model *= ObjectTransform;
-        MVP = VP * Matrices.model; // MVP = p * V * M
 
-        glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-        draw3DObject(goalObjects[current].object);
+        drawSprite(*pickupSprites[i], Matrices.model, LAYER_PICKUPS, i);
         //glPopMatrix (); 
     }
 
-    for(map<string,Sprite>::iterator it=objects.begin();it!=objects.end();it++){
-        string current = it->first; //The name of the current object
-        if(current!="floor" && current!="floor2" && current!="roof" && current!="wall1" && current!="wall2"){
-            if(objects[current].y>250){
-                objects[current].y=250;
-                objects[current].y_speed*=-1/2;
-            }
-            if(objects[current].y<-265){
-                objects[current].y=-265;
-                objects[current].y_speed*=-1;
-            }
-        }
-        if(objects[current].status==0)
+    //Draw the objects
+    for(int body=0;body<bodySprites.size();body++){
+        if((world.flags[body]&BODY_ALIVE)==0)
             continue;
-        if(objects[current].fixed==0 && objects[current].y_speed==0){
-            moveObject(current,0,-2);
-            int col_state=0;
-            for(map<string,Sprite>::iterator it3=objects.begin();it3!=objects.end();it3++){
-                if(it3->second.status==0)
-                    continue;
-                if(checkCollisionBottom(it3->second,objects[current]))
-                    col_state=1;
-            }
-            moveObject(current,0,2);
-            if(col_state==0){
-                objects[current].inAir=1;
-            }
-        }
-        if(objects[current].inAir && objects[current].fixed==0){
-            if(objects[current].y_speed>=-30)
-                objects[current].y_speed-=gravity*time_delta;
-            objects[current].x_speed-=airResistance*time_delta*objects[current].x_speed;
-            pair<float,float> position = moveObject(current,objects[current].x_speed*time_delta,0);
-            //We can also use the checkCollisionSphere here instead but since we don't have any rotated blocks currently we will stick with this
-            checkCollision(current,objects[current].x_speed*time_delta,0); //Always call the checkCollision function with only 1 position change at a time!
-            position = moveObject(current,0,objects[current].y_speed*time_delta);
-            //We can also use the checkCollisionSphere here instead but since we don't have any rotated blocks currently we will stick with this
-            checkCollision(current,0,objects[current].y_speed*time_delta);
-        }
-        glm::mat4 MVP;	// MVP = Projection * View * Model
+        if(world.height[body]!=bodySprites[body]->height) //The spring switch is squashed when pressed
+            resizeSprite(*bodySprites[body],bodySprites[body]->width,world.height[body]);
 
         Matrices.model = glm::mat4(1.0f);
 
         /* Render your scene */
 
         glm::mat4 ObjectTransform;
-
-        if(objects[current].isMovingAnim==1 && (current=="springbase2" || current=="springbase3")){
-            if(objects[current].dy>0){
-                float dy=objects[current].dy;
-                float y=objects[current].y;
-                if(current=="springbase3"){
-                    COLOR my_color = objects["springbase3"].color;	
-                    createRectangle("springbase3",10000,my_color,my_color,my_color,my_color,190,objects["springbase3"].y,objects["springbase3"].height-1,20,"");
-                    objects["springbase3"].fixed=1;
-                    y+=1/2.0;
-                    objects["springbase3"].isMovingAnim=1;
-                }
-                objects[current].dy=dy-1;
-                objects[current].y=y-1;
-                if(objects[current].dy==0){
-                    goalObjects["goal1"].status=1;
-                    goalObjects["goal2"].status=1;
-                    goalObjects["goal3"].status=1;
-                    objects[current].isMovingAnim=2;
-                    objects["springbase1"].isMovingAnim=2; //To activate the goal, check for the status of the springbase1,2 or 3 if its equal to 2
-                }
-            }
-        }
-
-        if (objects[current].isRotating==1 && current!="cannonball"){
-            objects[current].remAngle-=9;
-            float xShift = -0.5;
-            if(objects[current].direction==0){
-                xShift*=-1;
-                objects[current].angle-=9;
-            }
-            else
-                objects[current].angle+=9;
-            moveObject(current,xShift,0);
-            if(checkCollision(current,xShift,0)){
-                moveObject(current,-xShift,0);
-            }
-            if(objects[current].remAngle<=0){
-                objects[current].isRotating=0;
-            }
-        }
-        glm::mat4 translateObject = glm::translate (glm::vec3(objects[current].x, objects[current].y, 0.0f)); // glTranslatef
-        glm::mat4 rotateObjectAct = glm::rotate((float)(objects[current].angle*M_PI/180.0f), glm::vec3(0,0,1));  // rotate about vector (1,0,0)
+        glm::mat4 translateObject = glm::translate (glm::vec3(interpolatedX(body), interpolatedY(body), 0.0f)); // glTranslatef
+        glm::mat4 rotateObjectAct = glm::rotate((float)(world.angle[body]*M_PI/180.0f), glm::vec3(0,0,1));  // rotate about vector (1,0,0)
         ObjectTransform=translateObject*rotateObjectAct;
         Matrices.model *= ObjectTransform;
-        MVP = VP * Matrices.model; // MVP = p * V * M
 
-        glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-        draw3DObject(objects[current].object);
+        drawSprite(*bodySprites[body], Matrices.model, LAYER_BODIES, body);
         //glPopMatrix ();
     }
 
-    //Draw the first pig (pig1)
-    for(map<string,Sprite>::iterator it=pig1Objects.begin();it!=pig1Objects.end();it++){
-        string current = it->first; //The name of the current object
-        if(objects["pig1"].status==0 || pig1Objects[it->first].status==0)
+    //Draw the pigs, they get a black eye once their health drops below 60
+    int p;
+    for(p=0;p<(int)pig_bodies.size();p++){
+        int pig = pig_bodies[p];
+        if((world.flags[pig]&BODY_ALIVE)==0)
             continue;
-        glm::mat4 MVP;  // MVP = Projection * View * Model
-
-        Matrices.model = glm::mat4(1.0f);
-
-        glm::mat4 ObjectTransform;
-        float x_diff,y_diff;
-        x_diff=pig1Objects[current].x;
-        y_diff=pig1Objects[current].y;
-        glm::mat4 translateObject = glm::translate (glm::vec3(objects["pig1"].x+pig1Objects[current].x, objects["pig1"].y+pig1Objects[current].y, 0.0f)); // glTranslatef
-        glm::mat4 translateObject1 = glm::translate (glm::vec3(-x_diff, -y_diff, 0.0f));
-        glm::mat4 rotateTriangle = glm::rotate((float)((objects["pig1"].angle)*M_PI/180.0f), glm::vec3(0,0,1));  // rotate about vector (1,0,0)
-        glm::mat4 translateObject2 = glm::translate (glm::vec3(x_diff, y_diff, 0.0f));
-        ObjectTransform=translateObject*translateObject1*rotateTriangle*translateObject2;
-        Matrices.model *= ObjectTransform;
-        MVP = VP * Matrices.model; // MVP = p * V * M
-
-        glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-        draw3DObject(pig1Objects[current].object);
-        //glPopMatrix (); 
-    }
-
-    //Draw the second pig (pig2)
-    for(map<string,Sprite>::iterator it=pig2Objects.begin();it!=pig2Objects.end();it++){
-        string current = it->first; //The name of the current object
-        if(objects["pig2"].status==0 || pig2Objects[it->first].status==0)
-            continue;
-        glm::mat4 MVP;  // MVP = Projection * View * Model
-
-        Matrices.model = glm::mat4(1.0f);
-
-        glm::mat4 ObjectTransform;
-        float x_diff,y_diff;
-        x_diff=pig2Objects[current].x;
-        y_diff=pig2Objects[current].y;
-        glm::mat4 translateObject = glm::translate (glm::vec3(objects["pig2"].x+pig2Objects[current].x, objects["pig2"].y+pig2Objects[current].y, 0.0f)); // glTranslatef
-        glm::mat4 translateObject1 = glm::translate (glm::vec3(-x_diff, -y_diff, 0.0f));
-        glm::mat4 rotateTriangle = glm::rotate((float)((objects["pig2"].angle)*M_PI/180.0f), glm::vec3(0,0,1));  // rotate about vector (1,0,0)
-        glm::mat4 translateObject2 = glm::translate (glm::vec3(x_diff, y_diff, 0.0f));
-        ObjectTransform=translateObject*translateObject1*rotateTriangle*translateObject2;
-        Matrices.model *= ObjectTransform;
-        MVP = VP * Matrices.model; // MVP = p * V * M
-
-        glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-        draw3DObject(pig2Objects[current].object);
-        //glPopMatrix (); 
-    }
-
-    //Draw the third pig (pig3)
-    for(map<string,Sprite>::iterator it=pig3Objects.begin();it!=pig3Objects.end();it++){
-        string current = it->first; //The name of the current object
-        if(objects["pig3"].status==0 || pig3Objects[it->first].status==0)
-            continue;
-        glm::mat4 MVP;  // MVP = Projection * View * Model
-
-        Matrices.model = glm::mat4(1.0f);
+        string hurt_eye = p%4==1 ? "pigeye2hurt" : "pigeye1hurt";
+        pigObjects["pigeye1hurt"].status = hurt_eye=="pigeye1hurt" && world.health[pig]<60;
+        pigObjects["pigeye2hurt"].status = hurt_eye=="pigeye2hurt" && world.health[pig]<60;
+        for(map<string,Sprite>::iterator it=pigObjects.begin();it!=pigObjects.end();it++){
+            string current = it->first; //The name of the current object
+            if(pigObjects[current].status==0)
+                continue;
 
-        glm::mat4 ObjectTransform;
-        float x_diff,y_diff;
-        x_diff=pig3Objects[current].x;
-        y_diff=pig3Objects[current].y;
-        glm::mat4 translateObject = glm::translate (glm::vec3(objects["pig3"].x+pig3Objects[current].x, objects["pig3"].y+pig3Objects[current].y, 0.0f)); // glTranslatef
-        glm::mat4 translateObject1 = glm::translate (glm::vec3(-x_diff, -y_diff, 0.0f));
-        glm::mat4 rotateTriangle = glm::rotate((float)((objects["pig3"].angle)*M_PI/180.0f), glm::vec3(0,0,1));  // rotate about vector (1,0,0)
-        glm::mat4 translateObject2 = glm::translate (glm::vec3(x_diff, y_diff, 0.0f));
-        ObjectTransform=translateObject*translateObject1*rotateTriangle*translateObject2;
-        Matrices.model *= ObjectTransform;
-        MVP = VP * Matrices.model; // MVP = p * V * M
+            Matrices.model = glm::mat4(1.0f);
 
-        glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
+            glm::mat4 ObjectTransform;
+            float x_diff,y_diff;
+            x_diff=pigObjects[current].x;
+            y_diff=pigObjects[current].y;
+            glm::mat4 translateObject = glm::translate (glm::vec3(interpolatedX(pig)+pigObjects[current].x, interpolatedY(pig)+pigObjects[current].y, 0.0f)); // glTranslatef
+            glm::mat4 translateObject1 = glm::translate (glm::vec3(-x_diff, -y_diff, 0.0f));
+            glm::mat4 rotateTriangle = glm::rotate((float)((world.angle[pig])*M_PI/180.0f), glm::vec3(0,0,1));  // rotate about vector (1,0,0)
+            glm::mat4 translateObject2 = glm::translate (glm::vec3(x_diff, y_diff, 0.0f));
+            ObjectTransform=translateObject*translateObject1*rotateTriangle*translateObject2;
+            Matrices.model *= ObjectTransform;
 
-        draw3DObject(pig3Objects[current].object);
-        //glPopMatrix (); 
+            drawSprite(pigObjects[current], Matrices.model, LAYER_PIGS, p*pigObjects.size()+pigObjects[current].depth); //Every pig over the pigs before it
+        }
     }
 
-    //Draw the fourth pig (pig4)
-    for(map<string,Sprite>::iterator it=pig4Objects.begin();it!=pig4Objects.end();it++){
-        string current = it->first; //The name of the current object
-        if(objects["pig4"].status==0 || pig4Objects[it->first].status==0)
-            continue;
-        glm::mat4 MVP;  // MVP = Projection * View * Model
-
-        Matrices.model = glm::mat4(1.0f);
-
-        /* Render your scene */
-        glm::mat4 ObjectTransform;
-        float x_diff,y_diff;
-        x_diff=pig4Objects[current].x;
-        y_diff=pig4Objects[current].y;
-        glm::mat4 translateObject = glm::translate (glm::vec3(objects["pig4"].x+pig4Objects[current].x, objects["pig4"].y+pig4Objects[current].y, 0.0f)); // glTranslatef
-        glm::mat4 translateObject1 = glm::translate (glm::vec3(-x_diff, -y_diff, 0.0f));
-        glm::mat4 rotateTriangle = glm::rotate((float)((objects["pig4"].angle)*M_PI/180.0f), glm::vec3(0,0,1));  // rotate about vector (1,0,0)
-        glm::mat4 translateObject2 = glm::translate (glm::vec3(x_diff, y_diff, 0.0f));
-        ObjectTransform=translateObject*translateObject1*rotateTriangle*translateObject2;
-        Matrices.model *= ObjectTransform;
-        MVP = VP * Matrices.model; // MVP = p * V * M
-
-        glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-        draw3DObject(pig4Objects[current].object);
-        //glPopMatrix (); 
-    }
+    //Draw the debris of the destroyed bodies
+    submitDebris();
 
     //Draw the cannon
     for(map<string,Sprite>::iterator it=cannonObjects.begin();it!=cannonObjects.end();it++){
         string current = it->first; //The name of the current object
-        if(cannonObjects[current].isMovingAnim==1){
-            cannonObjects[current].x-=4;
-            cannonObjects[current].dx-=4;
-            if(cannonObjects[current].dx==0){
-                cannonObjects[current].isMovingAnim=2;
-                cannonObjects[current].dx=16;
-            }
-        }
-        if(cannonObjects[current].isMovingAnim==2){
-            cannonObjects[current].x+=1;
-            cannonObjects[current].dx-=1;
-            if(cannonObjects[current].dx==0){
-                cannonObjects[current].isMovingAnim=0;
-            }
-        }
         if(cannonObjects[current].status==0)
             continue;
-        glm::mat4 MVP;  // MVP = Projection * View * Model
 
         Matrices.model = glm::mat4(1.0f);
 
         /* Render your scene */
         glm::mat4 ObjectTransform;
-        glm::mat4 translateObject = glm::translate (glm::vec3(cannonObjects[current].x, cannonObjects[current].y, 0.0f)); // glTranslatef
+        glm::mat4 translateObject = glm::translate (glm::vec3(cannonObjects[current].x-world.cannon_recoil, cannonObjects[current].y, 0.0f)); // glTranslatef
         float x_diff,y_diff;
         x_diff=abs(cannonObjects["cannoncircle"].x-cannonObjects[current].x);
         y_diff=abs(cannonObjects["cannoncircle"].y-cannonObjects[current].y);
@@ -1528,39 +1343,30 @@ void draw (GLFWwindow* window)
         glm::mat4 translateObject2 = glm::translate (glm::vec3(x_diff, y_diff, 0.0f)); // glTranslatef
         ObjectTransform=translateObject*translateObject1*rotateTriangle*translateObject2;
         Matrices.model *= ObjectTransform;
-        MVP = VP * Matrices.model; // MVP = p * V * M
-
-        glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
 
-        draw3DObject(cannonObjects[current].object);
+        drawSprite(cannonObjects[current], Matrices.model, LAYER_CANNON, cannonObjects[current].depth);
         //glPopMatrix (); 
     }
 
 
-    if(backgroundObjects["scorebackground"].status==1){
+    if(world.popup.timer>0){
         //Draw the scorebox background
-        glm::mat4 MVP;
         Matrices.model = glm::mat4(1.0f);
         glm::mat4 ObjectTransform;
         glm::mat4 translateObject = glm::translate (glm::vec3(backgroundObjects["scorebackground"].x, backgroundObjects["scorebackground"].y, 0.0f)); 
         ObjectTransform=translateObject;
         Matrices.model *= ObjectTransform;
-        MVP = VP * Matrices.model; // MVP = p * V * M
-        glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-        draw3DObject(backgroundObjects["scorebackground"].object);
+        drawSprite(backgroundObjects["scorebackground"], Matrices.model, LAYER_POPUP, 0);
     }
 
     if(game_over==1){
         //Draw the scorebox background
-        glm::mat4 MVP;
         Matrices.model = glm::mat4(1.0f);
         glm::mat4 ObjectTransform;
         glm::mat4 translateObject = glm::translate (glm::vec3(backgroundObjects["endgame"].x, backgroundObjects["endgame"].y, 0.0f)); 
         ObjectTransform=translateObject;
         Matrices.model *= ObjectTransform;
-        MVP = VP * Matrices.model; // MVP = p * V * M
-        glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-        draw3DObject(backgroundObjects["endgame"].object);
+        drawSprite(backgroundObjects["endgame"], Matrices.model, LAYER_POPUP, 1);
     }
 
     //Draw the characters
@@ -1579,7 +1385,6 @@ void draw (GLFWwindow* window)
             
             string current = it2->first;
 
-            glm::mat4 MVP;  // MVP = Projection * View * Model
             Matrices.model = glm::mat4(1.0f);
 
             /* Render your scene */
@@ -1587,11 +1392,8 @@ void draw (GLFWwindow* window)
             glm::mat4 translateObject = glm::translate (glm::vec3(base_x+charCurrent[current].x, base_y+charCurrent[current].y, 0.0f)); // glTranslatef
             ObjectTransform=translateObject;
             Matrices.model *= ObjectTransform;
-            MVP = VP * Matrices.model; // MVP = p * V * M
-
-            glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
 
-            draw3DObject(charCurrent[current].object);
+            drawSprite(charCurrent[current], Matrices.model, LAYER_TEXT, charCurrent[current].depth);
             //glPopMatrix (); 
         }
     }
@@ -1607,7 +1409,6 @@ void draw (GLFWwindow* window)
             
             string current = it2->first;
 
-            glm::mat4 MVP;  // MVP = Projection * View * Model
             Matrices.model = glm::mat4(1.0f);
 
             /* Render your scene */
@@ -1615,11 +1416,8 @@ void draw (GLFWwindow* window)
             glm::mat4 translateObject = glm::translate (glm::vec3(base_x+it2->second.x, base_y+it2->second.y, 0.0f)); // glTranslatef
             ObjectTransform=translateObject;
             Matrices.model *= ObjectTransform;
-            MVP = VP * Matrices.model; // MVP = p * V * M
 
-            glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-            draw3DObject(it2->second.object);
+            drawSprite(it2->second, Matrices.model, LAYER_TEXT, it2->second.depth);
             //glPopMatrix (); 
         }
         base_x+=17; //Next character
@@ -1636,7 +1434,6 @@ void draw (GLFWwindow* window)
             
             string current = it2->first;
 
-            glm::mat4 MVP;  // MVP = Projection * View * Model
             Matrices.model = glm::mat4(1.0f);
 
             /* Render your scene */
@@ -1644,11 +1441,8 @@ void draw (GLFWwindow* window)
             glm::mat4 translateObject = glm::translate (glm::vec3(base_x+it2->second.x, base_y+it2->second.y, 0.0f)); // glTranslatef
             ObjectTransform=translateObject;
             Matrices.model *= ObjectTransform;
-            MVP = VP * Matrices.model; // MVP = p * V * M
-
-            glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
 
-            draw3DObject(it2->second.object);
+            drawSprite(it2->second, Matrices.model, LAYER_TEXT, it2->second.depth);
             //glPopMatrix (); 
         }
         base_x+=48; //Next character 
@@ -1668,7 +1462,6 @@ void draw (GLFWwindow* window)
             
             string current = it2->first;
 
-            glm::mat4 MVP;  // MVP = Projection * View * Model
             Matrices.model = glm::mat4(1.0f);
 
             /* Render your scene */
@@ -1676,16 +1469,33 @@ void draw (GLFWwindow* window)
             glm::mat4 translateObject = glm::translate (glm::vec3(base_x+it2->second.x, base_y+it2->second.y, 0.0f)); // glTranslatef
             ObjectTransform=translateObject;
             Matrices.model *= ObjectTransform;
-            MVP = VP * Matrices.model; // MVP = p * V * M
 
-            glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-            draw3DObject(it2->second.object);
+            drawSprite(it2->second, Matrices.model, LAYER_TEXT, it2->second.depth);
             //glPopMatrix (); 
         }
         base_x-=15; //Next character 
     }
     }
+
+    //Draw the physics readout, the phases of an average step side by side over the time a step may take
+    if(show_physics_stats==1){
+        const char *bars[] = {"statsbudget","statsintegration","statsbroadphase","statsnarrowphase","statsresponse"};
+        double budget_us=1e6/physics_hz;
+        double times[] = {budget_us,stats_shown.integration_us,stats_shown.broadphase_us,stats_shown.narrowphase_us,stats_shown.response_us};
+        float left=-370;
+        for(t=0;t<5;t++){
+            float width=min(times[t]/budget_us*200,30.0-left); //Up to twice the budget
+            if(width<=0)
+                break;
+            Sprite &bar = statsObjects[bars[t]];
+            resizeSprite(bar,width,bar.height);
+            drawSprite(bar, glm::translate (glm::vec3(left+width/2, bar.y, 0.0f)), LAYER_STATS, t);
+            if(t>0) //The phases follow each other over the budget
+                left+=width;
+        }
+    }
+
+    flushRenderQueue(VP);
 }
 
 /* Initialise glfw window, I/O callbacks and the renderer to use */
@@ -1765,12 +1575,8 @@ void initGL (GLFWwindow* window, int width, int height)
     characterPosY[2]=250;
     characterPosY[3]=250;
 
-    COLOR grey = {168.0/255.0,168.0/255.0,168.0/255.0};
     COLOR gold = {218.0/255.0,165.0/255.0,32.0/255.0};
-    COLOR coingold = {255.0/255.0,223.0/255.0,0.0/255.0};
     COLOR red = {255.0/255.0,51.0/255.0,51.0/255.0};
-    COLOR lightgreen = {57/255.0,230/255.0,0/255.0};
-    COLOR darkgreen = {51/255.0,102/255.0,0/255.0};
     COLOR black = {30/255.0,30/255.0,21/255.0};
     COLOR blue = {0,0,1};
     COLOR darkbrown = {46/255.0,46/255.0,31/255.0};
@@ -1778,7 +1584,6 @@ void initGL (GLFWwindow* window, int width, int height)
     COLOR brown1 = {117/255.0,78/255.0,40/255.0};
     COLOR brown2 = {134/255.0,89/255.0,40/255.0};
     COLOR brown3 = {46/255.0,46/255.0,31/255.0};
-    COLOR cratebrown = {153/255.0,102/255.0,0/255.0};
     COLOR cratebrown1 = {121/255.0,85/255.0,0/255.0};
     COLOR cratebrown2 = {102/255.0,68/255.0,0/255.0};
     COLOR skyblue2 = {113/255.0,185/255.0,209/255.0};
@@ -1791,165 +1596,74 @@ void initGL (GLFWwindow* window, int width, int height)
     COLOR white = {255/255.0,255/255.0,255/255.0};
     COLOR score = {117/255.0,78/255.0,40/255.0};
 
-    createRectangle("asky1",10000,skyblue,skyblue,skyblue,skyblue,0,0,600,800,"background");
-    createRectangle("asky2",10000,skyblue1,skyblue1,skyblue1,skyblue1,0,-200,600,800,"background");
-    createRectangle("asky3",10000,skyblue2,skyblue2,skyblue2,skyblue2,0,-400,600,800,"background");
-
-    createRectangle("cloud1a",10000,cloudwhite,cloudwhite,cloudwhite,cloudwhite,-170,110,100,160,"background");
-    createRectangle("cloud1b",10000,cloudwhite1,cloudwhite1,cloudwhite1,cloudwhite1,-180,110,40,260,"background");
-    createRectangle("cloud2a",10000,cloudwhite,cloudwhite,cloudwhite,cloudwhite,190,160,100,160,"background");
-    createRectangle("cloud2b",10000,cloudwhite1,cloudwhite1,cloudwhite1,cloudwhite1,190,155,40,270,"background");
-    createCircle("cloud1ac1",10000,cloudwhite,-250,110,50,15,"background",1);
-    createCircle("cloud1ac2",10000,cloudwhite,-90,110,50,15,"background",1); //Last param is fill
-    createCircle("cloud1bc1",10000,cloudwhite1,-310,110,20,15,"background",1);
-    createCircle("cloud1bc2",10000,cloudwhite1,-40,110,20,15,"background",1); //Last param is fill
-    createCircle("cloud2ac1",10000,cloudwhite,110,160,50,15,"background",1);
-    createCircle("cloud2ac2",10000,cloudwhite,270,160,50,15,"background",1); //Last param is fill
-    createCircle("cloud2bc1",10000,cloudwhite1,60,155,20,15,"background",1);
-    createCircle("cloud2bc2",10000,cloudwhite1,320,155,20,15,"background",1); //Last param is fill
-
-    createRectangle("cannonpower1",10000,cratebrown2,cratebrown2,cratebrown2,cratebrown2,-270,250,40,200,"background");
-    createRectangle("cannonpower2",10000,cratebrown1,cratebrown1,cratebrown1,cratebrown1,-270,250,25,160,"background");
-    createRectangle("cannonpowerdisplay",10000,red,red,red,red,-270,250,25,0,"background");
-
-    createRectangle("skyfloor1",10000,cratebrown1,cratebrown1,cratebrown1,cratebrown1,190,30,20,100,"");
-    objects["skyfloor1"].fixed=1;
-    createRectangle("skyfloor2",10000,cratebrown1,cratebrown1,cratebrown1,cratebrown1,230,60,60,20,"");
-    objects["skyfloor2"].fixed=1;
-    createRectangle("skyfloor3",10000,cratebrown1,cratebrown1,cratebrown1,cratebrown1,270,90,20,100,"");
-    objects["skyfloor3"].fixed=1;
-    createRectangle("springbase1",10000,cratebrown2,cratebrown2,cratebrown2,cratebrown2,190,50,20,40,"");
-    objects["springbase1"].fixed=1;
-    createRectangle("springbase2",10000,cratebrown2,cratebrown2,cratebrown2,cratebrown2,190,90,20,40,"");
-    objects["springbase2"].fixed=1;
-    createRectangle("springbase3",10000,cratebrown,cratebrown,cratebrown,cratebrown,190,70,40,20,"");
-    objects["springbase3"].fixed=1;
-
-    createRectangle("groundfloor1",10000,cratebrown1,cratebrown1,cratebrown1,cratebrown1,-50,-260,20,20,"");
-    objects["groundfloor1"].fixed=1;
-    createRectangle("groundfloor2",10000,cratebrown1,cratebrown1,cratebrown1,cratebrown1,-10,-240,20,100,"");
-    objects["groundfloor2"].fixed=1;
-    createRectangle("groundfloor3",10000,cratebrown1,cratebrown1,cratebrown1,cratebrown1,30,-260,20,20,"");
-    objects["groundfloor3"].fixed=1;
-
-    createCircle("cannonball",2,black,-315,-270,15,10,"",1); //Generate sprites
-    objects["cannonball"].friction=0.3;
-    createRectangle("crate1",1,cratebrown,cratebrown2,cratebrown2,cratebrown,160,-100,60,60,"");
-    createRectangle("crate2",1,cratebrown,cratebrown2,cratebrown2,cratebrown,160,-160,30,30,"");
-    createRectangle("crate3",1,cratebrown,cratebrown2,cratebrown2,cratebrown,160,-190,30,30,"");
-    createRectangle("crate4",1,cratebrown,cratebrown2,cratebrown2,cratebrown,160,-220,30,30,"");
-
-    //On the skyfloor
-    createRectangle("crate5",1,cratebrown,cratebrown2,cratebrown2,cratebrown,270,140,40,40,"");
-
-    createCircle("pig1",1,lightpink,320,-155,20,15,"",1);
-    createCircle("pig1ear1",1,lightpink,-17,13,7,15,"pig1",1); //Store x and y offsets from pig1 as x,y here
-    createCircle("pig1ear2",1,lightpink,17,13,7,15,"pig1",1); //Store x and y offsets from pig1 as x,y here
-    //createCircle("pig1ear1in",1,darkpink,-17,14,4,15,"pig1",1); //Store x and y offsets from pig1 as x,y here
-    //createCircle("pig1ear2in",1,darkpink,17,14,4,15,"pig1",1); //Store x and y offsets from pig1 as x,y here
-    createCircle("pig1eye1main",1,white,-15,0,5,15,"pig1",1); //Store x and y offsets from pig1 as x,y here
-    createCircle("pig1eye1hurt",1,darkbrown,-14,0,8,15,"pig1",1); //Store x and y offsets from pig1 as x,y here
-    createCircle("pig1eye2main",1,white,15,0,5,15,"pig1",1); //Store x and y offsets from pig1 as x,y here
-    pig1Objects["pig1eye1hurt"].status=0;
-    createCircle("pig1eyeball1",1,black,-13,0,2,15,"pig1",1); //Store x and y offsets from pig1 as x,y here
-    createCircle("pig1eyeball2",1,black,13,0,2,15,"pig1",1); //Store x and y offsets from pig1 as x,y here
-    createCircle("pig1nose",1,darkpink,0,-5,10,15,"pig1",1); //Store x and y offsets from pig1 as x,y here
-    createCircle("pig1nose1",1,darkbrown,2.4,-5,2.4,15,"pig1",1); //Store x and y offsets from pig1 as x,y here
-    createCircle("pig1nose2",1,darkbrown,-2.4,-5,2.4,15,"pig1",1); //Store x and y offsets from pig1 as x,y here
-
-    createCircle("pig2",1,lightpink,0,-150,20,15,"",1);
-    createCircle("pig2ear1",1,lightpink,-17,13,7,15,"pig2",1); //Store x and y offsets from pig2 as x,y here
-    createCircle("pig2ear2",1,lightpink,17,13,7,15,"pig2",1); //Store x and y offsets from pig2 as x,y here
-    //createCircle("pig2ear1in",1,darkpink,-17,14,4,15,"pig2",1); //Store x and y offsets from pig2 as x,y here
-    //createCircle("pig2ear2in",1,darkpink,17,14,4,15,"pig2",1); //Store x and y offsets from pig2 as x,y here
-    createCircle("pig2eye1main",1,white,-15,0,5,15,"pig2",1); //Store x and y offsets from pig2 as x,y here
-    createCircle("pig2eye2main",1,white,15,0,5,15,"pig2",1); //Store x and y offsets from pig2 as x,y here
-    createCircle("pig2eye2hurt",1,darkbrown,14,0,8,15,"pig2",1); //Store x and y offsets from pig1 as x,y here
-    pig2Objects["pig2eye2hurt"].status=0;
-    createCircle("pig2eyeball1",1,black,-13,0,2,15,"pig2",1); //Store x and y offsets from pig2 as x,y here
-    createCircle("pig2eyeball2",1,black,13,0,2,15,"pig2",1); //Store x and y offsets from pig2 as x,y here
-    createCircle("pig2nose",1,darkpink,0,-5,10,15,"pig2",1); //Store x and y offsets from pig2 as x,y here
-    createCircle("pig2nose1",1,darkbrown,2.4,-5,2.4,15,"pig2",1); //Store x and y offsets from pig2 as x,y here
-    createCircle("pig2nose2",1,darkbrown,-2.4,-5,2.4,15,"pig2",1); //Store x and y offsets from pig2 as x,y here
-
-    createCircle("pig3",1,lightpink,270,255,20,15,"",1);
-    createCircle("pig3ear1",1,lightpink,-17,13,7,15,"pig3",1); //Store x and y offsets from pig3 as x,y here
-    createCircle("pig3ear2",1,lightpink,17,13,7,15,"pig3",1); //Store x and y offsets from pig3 as x,y here
-    //createCircle("pig1ear1in",1,darkpink,-17,14,4,15,"pig1",1); //Store x and y offsets from pig3 as x,y here
-    //createCircle("pig1ear2in",1,darkpink,17,14,4,15,"pig1",1); //Store x and y offsets from pig3 as x,y here
-    createCircle("pig3eye1main",1,white,-15,0,5,15,"pig3",1); //Store x and y offsets from pig3 as x,y here
-    createCircle("pig3eye1hurt",1,darkbrown,-14,0,8,15,"pig3",1); //Store x and y offsets from pig3 as x,y here
-    createCircle("pig3eye2main",1,white,15,0,5,15,"pig3",1); //Store x and y offsets from pig3 as x,y here
-    pig3Objects["pig3eye1hurt"].status=0;
-    createCircle("pig3eyeball1",1,black,-13,0,2,15,"pig3",1); //Store x and y offsets from pig3 as x,y here
-    createCircle("pig3eyeball2",1,black,13,0,2,15,"pig3",1); //Store x and y offsets from pig3 as x,y here
-    createCircle("pig3nose",1,darkpink,0,-5,10,15,"pig3",1); //Store x and y offsets from pig3 as x,y here
-    createCircle("pig3nose1",1,darkbrown,2.4,-5,2.4,15,"pig3",1); //Store x and y offsets from pig3 as x,y here
-    createCircle("pig3nose2",1,darkbrown,-2.4,-5,2.4,15,"pig3",1); //Store x and y offsets from pig3 as x,y here
-
-    createCircle("pig4",1,lightpink,160,0,20,15,"",1);
-    createCircle("pig4ear1",1,lightpink,-17,13,7,15,"pig4",1); //Store x and y offsets from pig4 as x,y here
-    createCircle("pig4ear2",1,lightpink,17,13,7,15,"pig4",1); //Store x and y offsets from pig4 as x,y here
-    //createCircle("pig1ear1in",1,darkpink,-17,14,4,15,"pig1",1); //Store x and y offsets from pig4 as x,y here
-    //createCircle("pig1ear2in",1,darkpink,17,14,4,15,"pig1",1); //Store x and y offsets from pig4 as x,y here
-    createCircle("pig4eye1main",1,white,-15,0,5,15,"pig4",1); //Store x and y offsets from pig4 as x,y here
-    createCircle("pig4eye1hurt",1,darkbrown,-14,0,8,15,"pig4",1); //Store x and y offsets from pig4 as x,y here
-    createCircle("pig4eye2main",1,white,15,0,5,15,"pig4",1); //Store x and y offsets from pig4 as x,y here
-    pig4Objects["pig4eye1hurt"].status=0;
-    createCircle("pig4eyeball1",1,black,-13,0,2,15,"pig4",1); //Store x and y offsets from pig4 as x,y here
-    createCircle("pig4eyeball2",1,black,13,0,2,15,"pig4",1); //Store x and y offsets from pig4 as x,y here
-    createCircle("pig4nose",1,darkpink,0,-5,10,15,"pig4",1); //Store x and y offsets from pig4 as x,y here
-    createCircle("pig4nose1",1,darkbrown,2.4,-5,2.4,15,"pig4",1); //Store x and y offsets from pig4 as x,y here
-    createCircle("pig4nose2",1,darkbrown,-2.4,-5,2.4,15,"pig4",1); //Store x and y offsets from pig4 as x,y here
-
-
-    createRectangle("floor",10000,lightgreen,lightgreen,lightgreen,lightgreen,0,-300,60,800,"");
-    objects["floor"].fixed=1;
-    objects["floor"].friction=0.5;
-    createRectangle("floor2",10000,darkgreen,lightgreen,lightgreen,darkgreen,0,-290,20,800,"");
-    objects["floor2"].fixed=1;
-    objects["floor2"].friction=0.5;
-    createRectangle("roof",10000,grey,grey,grey,grey,0,300,60,800,"");
-    objects["roof"].fixed=1;
-    objects["roof"].friction=0.5;
-    createRectangle("wall1",10000,grey,grey,grey,grey,-400,0,600,60,"");
-    objects["wall1"].fixed=1;
-    objects["wall1"].friction=0.5;
-    createRectangle("wall2",10000,grey,grey,grey,grey,400,0,600,60,"");
-    objects["wall2"].fixed=1;
-    objects["wall2"].friction=0.5;
-
-    createCircle("cannonaim",100000,darkbrown,-315,-210,150,12,"cannon",0);
+    //Sprites are drawn over the ones created before them in their component (See storeSprite)
+    createRectangle("asky1",skyblue,skyblue,skyblue,skyblue,0,0,600,800,"background");
+    createRectangle("asky2",skyblue1,skyblue1,skyblue1,skyblue1,0,-200,600,800,"background");
+    createRectangle("asky3",skyblue2,skyblue2,skyblue2,skyblue2,0,-400,600,800,"background");
+
+    createRectangle("cannonpower1",cratebrown2,cratebrown2,cratebrown2,cratebrown2,-270,250,40,200,"background");
+    createRectangle("cannonpower2",cratebrown1,cratebrown1,cratebrown1,cratebrown1,-270,250,25,160,"background");
+    createRectangle("cannonpowerdisplay",red,red,red,red,-270,250,25,0,"background");
+
+    createRectangle("cloud1a",cloudwhite,cloudwhite,cloudwhite,cloudwhite,-170,110,100,160,"background");
+    createCircle("cloud1ac1",cloudwhite,-250,110,50,15,"background",1);
+    createCircle("cloud1ac2",cloudwhite,-90,110,50,15,"background",1); //Last param is fill
+    createRectangle("cloud1b",cloudwhite1,cloudwhite1,cloudwhite1,cloudwhite1,-180,110,40,260,"background");
+    createCircle("cloud1bc1",cloudwhite1,-310,110,20,15,"background",1);
+    createCircle("cloud1bc2",cloudwhite1,-40,110,20,15,"background",1); //Last param is fill
+    createRectangle("cloud2a",cloudwhite,cloudwhite,cloudwhite,cloudwhite,190,160,100,160,"background");
+    createCircle("cloud2ac1",cloudwhite,110,160,50,15,"background",1);
+    createCircle("cloud2ac2",cloudwhite,270,160,50,15,"background",1); //Last param is fill
+    createRectangle("cloud2b",cloudwhite1,cloudwhite1,cloudwhite1,cloudwhite1,190,155,40,270,"background");
+    createCircle("cloud2bc1",cloudwhite1,60,155,20,15,"background",1);
+    createCircle("cloud2bc2",cloudwhite1,320,155,20,15,"background",1); //Last param is fill
+
+    //Bars of the physics readout, 1 wide and stretched to the time of their phase when drawn
+    createRectangle("statsbudget",cratebrown2,cratebrown2,cratebrown2,cratebrown2,0,215,10,1,"stats");
+    createRectangle("statsintegration",blue,blue,blue,blue,0,215,10,1,"stats");
+    createRectangle("statsbroadphase",gold,gold,gold,gold,0,215,10,1,"stats");
+    createRectangle("statsnarrowphase",red,red,red,red,0,215,10,1,"stats");
+    createRectangle("statsresponse",white,white,white,white,0,215,10,1,"stats");
+
+    //The same parts are drawn around every pig, offsets from its centre are stored as x,y here
+    createCircle("pigear1",lightpink,-17,13,7,15,"pig",1);
+    createCircle("pigear2",lightpink,17,13,7,15,"pig",1);
+    createCircle("pigeye1hurt",darkbrown,-14,0,8,15,"pig",1); //The black eye, under the eye
+    createCircle("pigeye1main",white,-15,0,5,15,"pig",1);
+    createCircle("pigeye2hurt",darkbrown,14,0,8,15,"pig",1);
+    createCircle("pigeye2main",white,15,0,5,15,"pig",1);
+    createCircle("pigeyeball1",black,-13,0,2,15,"pig",1);
+    createCircle("pigeyeball2",black,13,0,2,15,"pig",1);
+    createCircle("pignose",darkpink,0,-5,10,15,"pig",1);
+    createCircle("pignose1",darkbrown,2.4,-5,2.4,15,"pig",1);
+    createCircle("pignose2",darkbrown,-2.4,-5,2.4,15,"pig",1);
+
+
+    createCircle("cannonaim",darkbrown,-315,-210,150,12,"cannon",0);
     cannonObjects["cannonaim"].status=0;
-    createRectangle("cannonrectangle",100000,darkbrown,darkbrown,darkbrown,darkbrown,-235,-210,50,80,"cannon");
-    cannonObjects["cannonrectangle"].angle=45;
-
-    createCircle("cannoncircle",100000,darkbrown,-315,-210,50,12,"cannon",1); 
-    //The objects are drawn in the lexicographic ordering of their names
-    createCircle("cannoncircle2",100000,brown1,-315,-210,40,12,"cannon",1);
 
-    createCircle("cannonawheel2",100000,darkbrown,-315,-250,30,12,"cannon",1);
-    createCircle("cannonawheel22",100000,lightbrown,-315,-250,25,12,"cannon",1);
-    createCircle("cannonawheel222",100000,brown2,-315,-250,20,12,"cannon",1);
-    createCircle("cannonwheel1",100000,darkbrown,-295,-255,30,12,"cannon",1); 
-    createCircle("cannonwheel11",100000,lightbrown,-295,-255,25,12,"cannon",1);
-    createCircle("cannonwheel111",100000,brown2,-295,-255,20,12,"cannon",1);
+    //The back wheel is behind the cannon, the front wheel in front of it
+    createCircle("cannonawheel2",darkbrown,-315,-250,30,12,"cannon",1);
+    createCircle("cannonawheel22",lightbrown,-315,-250,25,12,"cannon",1);
+    createCircle("cannonawheel222",brown2,-315,-250,20,12,"cannon",1);
 
-    createRectangle("cannonbase1",100000,brown3,brown3,brown3,brown3,-355,-270,20,27,"cannon");
-    createRectangle("cannonbase2",100000,brown3,brown3,brown3,brown3,-355,-245,30,20,"cannon");
+    createRectangle("cannonbase1",brown3,brown3,brown3,brown3,-355,-270,20,27,"cannon");
+    createRectangle("cannonbase2",brown3,brown3,brown3,brown3,-355,-245,30,20,"cannon");
     cannonObjects["cannonbase2"].angle=-20;
 
-    createCircle("coin1",100000,coingold,320,-40,15,12,"coin",1);
-    createCircle("coin2",100000,coingold,20,-40,15,12,"coin",1);
+    createCircle("cannoncircle",darkbrown,-315,-210,50,12,"cannon",1); 
+    createCircle("cannoncircle2",brown1,-315,-210,40,12,"cannon",1);
+    createRectangle("cannonrectangle",darkbrown,darkbrown,darkbrown,darkbrown,-235,-210,50,80,"cannon");
+    cannonObjects["cannonrectangle"].angle=45;
+
+    createCircle("cannonwheel1",darkbrown,-295,-255,30,12,"cannon",1); 
+    createCircle("cannonwheel11",lightbrown,-295,-255,25,12,"cannon",1);
+    createCircle("cannonwheel111",brown2,-295,-255,20,12,"cannon",1);
 
-    createCircle("goal1",100000,darkgreen,130,-40,15,15,"goal",1);
-    goalObjects["goal1"].status=0;
-    createCircle("goal2",100000,darkgreen,-120,150,15,15,"goal",1);
-    goalObjects["goal2"].status=0;
-    createCircle("goal3",100000,darkgreen,-320,0,15,15,"goal",1);
-    goalObjects["goal3"].status=0;
+    createCircle("trajectorydot",white,0,0,3,8,"background",1); //Drawn at every dot of the trajectory preview
+    backgroundObjects["trajectorydot"].status=0;
 
-    createCircle("scorebackground",100000,gold,0,0,35,8,"background",1);
+    createCircle("scorebackground",gold,0,0,35,8,"background",1);
     backgroundObjects["scorebackground"].status=0;
     //Render the characters for the score
     int t;
@@ -1998,21 +1712,41 @@ void initGL (GLFWwindow* window, int width, int height)
         if(t==10){
             color = red;
         }
-        createRectangle("top",100000,color,color,color,color,0,offset,height,width,layer);
-        createRectangle("bottom",100000,color,color,color,color,0,-offset,height,width,layer);
-        createRectangle("middle",100000,color,color,color,color,0,0,height,width,layer);
-        createRectangle("left1",100000,color,color,color,color,-offset/2,offset/2,width,height,layer);
-        createRectangle("left2",100000,color,color,color,color,-offset/2,-offset/2,width,height,layer);
-        createRectangle("right1",100000,color,color,color,color,offset/2,offset/2,width,height,layer);
-        createRectangle("right2",100000,color,color,color,color,offset/2,-offset/2,width,height,layer);
-        createRectangle("middle1",100000,color,color,color,color,0,offset/2,width,height,layer);
-        createRectangle("middle2",100000,color,color,color,color,0,-offset/2,width,height,layer);
+        createRectangle("top",color,color,color,color,0,offset,height,width,layer);
+        createRectangle("bottom",color,color,color,color,0,-offset,height,width,layer);
+        createRectangle("middle",color,color,color,color,0,0,height,width,layer);
+        createRectangle("left1",color,color,color,color,-offset/2,offset/2,width,height,layer);
+        createRectangle("left2",color,color,color,color,-offset/2,-offset/2,width,height,layer);
+        createRectangle("right1",color,color,color,color,offset/2,offset/2,width,height,layer);
+        createRectangle("right2",color,color,color,color,offset/2,-offset/2,width,height,layer);
+        createRectangle("middle1",color,color,color,color,0,offset/2,width,height,layer);
+        createRectangle("middle2",color,color,color,color,0,-offset/2,width,height,layer);
     }
 
+    //The bodies and pickups come from the simulation, build a sprite for each of them
+    int b;
+    for(b=0;b<bodyCount();b++){
+        const BodyShape &shape = bodyShape(b);
+        createShape(shape,world.x[b],world.y[b],shape.height,"");
+        bodySprites.push_back(&objects[shape.name]);
+    }
+    for(b=0;b<pickupCount();b++){
+        const Pickup &p = pickup(b);
+        createShape(p.shape,p.x,p.y,p.shape.height,"pickup");
+        pickupSprites.push_back(&pickupObjects[p.shape.name]);
+    }
+    for(b=0;b<bodyCount();b++)
+        if(world.flags[b]&BODY_PIG)
+            pig_bodies.push_back(b);
+
     // Create and compile our GLSL program from the shaders
     programID = LoadShaders( "Sample_GL.vert", "Sample_GL.frag" );
-    // Get a handle for our "MVP" uniform
-    Matrices.MatrixID = glGetUniformLocation(programID, "MVP");
+    // Get a handle for our "VP" uniform
+    Matrices.MatrixID = glGetUniformLocation(programID, "VP");
+    debris_programID = LoadShaders( "Debris.vert", "Sample_GL.frag" );
+    debris_MatrixID = glGetUniformLocation(debris_programID, "VP");
+    debris_DepthID = glGetUniformLocation(debris_programID, "depth");
+    createDebrisBuffers();
 
 
     reshapeWindow (window, width, height);
@@ -2045,6 +1779,30 @@ int main (int argc, char** argv)
     endLabel="";
     endLabel_x=-160;
 
+    if(argc>1)
+        physics_threads=max(1,atoi(argv[1]));
+    startIslandWorkers();
+    if(argc>2){ //A generated level instead, like ./simulate
+        int layout = stressLayout(argv[2]);
+        int level_objects = argc>3 ? atoi(argv[3]) : 1000;
+        if(layout<0){
+            cerr << "Unknown layout " << argv[2] << ", use towers, rubble or grid" << endl;
+            return 1;
+        }
+        loadStressLevel(layout,level_objects*80/100,level_objects*15/100,level_objects-level_objects*80/100-level_objects*15/100,argc>4 ? strtoul(argv[4],NULL,10) : 1);
+    }
+    else
+        loadLevel();
+    recordHistory(rewind_seconds*physics_hz);
+    takeSnapshot(world);
+
+    //The camera can pan over the whole level and zoom out until all of it fits
+    map_left=world.x[bodyHandle("wall1")];
+    map_right=world.x[bodyHandle("wall2")];
+    map_bottom=world.y[bodyHandle("floor")];
+    map_top=world.y[bodyHandle("roof")];
+    zoom_min=min(1.0f,min(800/(map_right-map_left),600/(map_top-map_bottom)));
+
     GLFWwindow* window = initGLFW(width, height);
 
     initGL (window, width, height);
@@ -2059,8 +1817,50 @@ int main (int argc, char** argv)
     while (!glfwWindowShouldClose(window)) {
 
         cur_time = glfwGetTime(); // Time in seconds
+
+        // Advance the physics in fixed steps, independent of the frame rate
+        // (The small tolerance keeps frame times that are exact multiples of the step from drifting by rounding)
+        int substeps = 0;
+        physics_accumulator += (cur_time-old_time)*physics_hz;
+        while (physics_accumulator >= 1-1e-6 && substeps < max_substeps) {
+            if(game_over!=1){
+                stepPhysics();
+                const PhysicsStats &stats = physicsStats();
+                stats_sum.bodies_integrated+=stats.bodies_integrated;
+                stats_sum.ground_probes+=stats.ground_probes;
+                stats_sum.pairs_tested+=stats.pairs_tested;
+                stats_sum.pairs_culled+=stats.pairs_culled;
+                stats_sum.contacts_resolved+=stats.contacts_resolved;
+                stats_sum.destroyed+=stats.destroyed;
+                stats_sum.integration_us+=stats.integration_us;
+                stats_sum.broadphase_us+=stats.broadphase_us;
+                stats_sum.narrowphase_us+=stats.narrowphase_us;
+                stats_sum.response_us+=stats.response_us;
+                stats_sum.step_us+=stats.step_us;
+                stats_steps++;
+                const vector<CollisionEvent> &events = stepEvents();
+                for(int e=0;e<events.size();e++){
+                    if(events[e].type!=EVENT_DESTROYED)
+                        continue;
+                    const BodyShape &shape = bodyShape(events[e].other);
+                    spawnDebris(events[e].x,events[e].y-shape.height/2,shape.width,shape.height,shape.color);
+                }
+            }
+            physics_accumulator -= 1;
+            substeps++;
+        }
+        if (physics_accumulator >= 1) // Too far behind, drop the time instead of catching up
+            physics_accumulator -= floor(physics_accumulator);
+        if(click_time>=0 && glfwGetTime()-click_time>=2){ //Only once, teleporting the ball wakes it
+            resetCannonball();
+            click_time=-1;
+        }
+        takeSnapshot(world);
+        if(game_over!=1)
+            stepDebris((cur_time-old_time)*60);
+
         // OpenGL Draw commands
-        draw(window);
+        draw(window, max(0.0, physics_accumulator));
         old_time=cur_time;
 
         // Swap Frame Buffer in double buffering
@@ -2073,6 +1873,19 @@ int main (int argc, char** argv)
         current_time = glfwGetTime(); // Time in seconds
         if ((current_time - last_update_time) >= 0.5) { // atleast 0.5s elapsed since last frame
             // do something every 0.5 seconds ..
+            int n=max(stats_steps,1);
+            stats_shown=stats_sum;
+            stats_shown.integration_us/=n;
+            stats_shown.broadphase_us/=n;
+            stats_shown.narrowphase_us/=n;
+            stats_shown.response_us/=n;
+            stats_shown.step_us/=n;
+            if(show_physics_stats==1){
+                cout << "PHYSICS per step: " << stats_sum.bodies_integrated/n << " integrated, " << stats_sum.ground_probes/n << " ground probes, " << stats_sum.pairs_tested/n << " pairs tested (" << stats_sum.pairs_culled/n << " culled), " << stats_sum.contacts_resolved/n << " contacts, " << stats_sum.destroyed << " destroyed, " << bodies_awake << " awake" << endl;
+                cout << "PHYSICS us per step: integration " << stats_shown.integration_us << " broadphase " << stats_shown.broadphase_us << " narrowphase " << stats_shown.narrowphase_us << " response " << stats_shown.response_us << " step " << stats_shown.step_us << " (budget " << 1e6/physics_hz << ")" << endl;
+            }
+            stats_sum=PhysicsStats();
+            stats_steps=0;
             last_update_time = current_time;
         }
     }
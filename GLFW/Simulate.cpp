@@ -0,0 +1,97 @@
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+
+#include "Simulation.h"
+
+using namespace std;
+
+/* Simulate - Runs the level headless, without a window or OpenGL */
+//Usage: ./simulate [steps] [angle] [power] [threads] [layout objects seed]
+//Fires the cannon once and steps the world, then prints the speed and the result. The checksum of the final
+//positions is the same for any number of threads, so it can be compared between builds. The world hash only matches
+//when the final worlds are bit-identical, which the fixed point physics has to give with any compiler and flags.
+//With a layout ("towers", "rubble" or "grid") it steps a generated level of that many objects instead of the game's,
+//80% crates, 15% pigs and 5% coins.
+//The counters and timings of the phases are printed as averages per step, timing them costs a few percent of the speed.
+
+int main (int argc, char** argv)
+{
+    int steps = argc>1 ? atoi(argv[1]) : 10000;
+    double angle = argc>2 ? atof(argv[2]) : 45;
+    double power = argc>3 ? atof(argv[3]) : 178240;
+    if(argc>4)
+        physics_threads=max(1,atoi(argv[4]));
+    startIslandWorkers();
+    physics_timings=1;
+
+    if(argc>5){
+        int layout = stressLayout(argv[5]);
+        int objects = argc>6 ? atoi(argv[6]) : 1000;
+        unsigned seed = argc>7 ? strtoul(argv[7],NULL,10) : 1;
+        if(layout<0){
+            cerr << "Unknown layout " << argv[5] << ", use towers, rubble or grid" << endl;
+            return 1;
+        }
+        chrono::steady_clock::time_point load = chrono::steady_clock::now();
+        loadStressLevel(layout,objects*80/100,objects*15/100,objects-objects*80/100-objects*15/100,seed);
+        cout << "level: " << argv[5] << " " << bodyCount() << " bodies " << pickupCount() << " coins (seed " << seed << ", " << chrono::duration<double>(chrono::steady_clock::now()-load).count() << "s to load)" << endl;
+    }
+    else
+        loadLevel();
+    fireCannon(angle,power);
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    int i;
+    long long events=0;
+    PhysicsStats total = {};
+    for(i=0;i<steps;i++){
+        stepPhysics();
+        events+=stepEvents().size();
+        const PhysicsStats &stats = physicsStats();
+        total.bodies_integrated+=stats.bodies_integrated;
+        total.ground_probes+=stats.ground_probes;
+        total.pairs_tested+=stats.pairs_tested;
+        total.contacts_resolved+=stats.contacts_resolved;
+        total.integration_us+=stats.integration_us;
+        total.broadphase_us+=stats.broadphase_us;
+        total.narrowphase_us+=stats.narrowphase_us;
+        total.response_us+=stats.response_us;
+        total.step_us+=stats.step_us;
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now()-start).count();
+
+    WorldSnapshot world;
+    takeSnapshot(world);
+    int destroyed=0;
+    double checksum=0;
+    unsigned long long hash=14695981039346656037ULL; //FNV-1a over the bits of the positions, flags and health
+    int body;
+    for(body=0;body<bodyCount();body++){
+        if((world.flags[body]&BODY_ALIVE)==0)
+            destroyed++;
+        checksum+=(body+1)*(world.x[body]+2*world.y[body]);
+        unsigned state[4];
+        memcpy(&state[0],&world.x[body],4);
+        memcpy(&state[1],&world.y[body],4);
+        state[2]=world.flags[body];
+        state[3]=world.health[body];
+        for(int i=0;i<4;i++)
+            hash=(hash^state[i])*1099511628211ULL;
+    }
+
+    cout << "steps: " << steps << " (" << steps/physics_hz << "s of game time)" << endl;
+    cout << "steps/sec: " << (seconds>0 ? steps/seconds : 0) << endl;
+    cout << "score: " << world.score << endl;
+    cout << "destroyed: " << destroyed << endl;
+    cout << "events: " << events << endl;
+    //Per step on average, the phases don't add up to the step (sleeping, events and history are left out)
+    int n = max(steps,1);
+    cout << "per step: " << total.bodies_integrated/n << " bodies integrated, " << total.ground_probes/n << " ground probes, " << total.pairs_tested/n << " pairs tested, " << total.contacts_resolved/n << " contacts resolved" << endl;
+    cout << "us per step: integration " << total.integration_us/n << ", broadphase " << total.broadphase_us/n << ", narrowphase " << total.narrowphase_us/n << ", response " << total.response_us/n << ", step " << total.step_us/n << endl;
+    cout.precision(10);
+    cout << "checksum: " << checksum << endl;
+    cout << "world hash: " << hex << hash << dec << endl;
+    return 0;
+}
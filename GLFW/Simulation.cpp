@@ -0,0 +1,3083 @@
+#include <iostream>
+#include <cmath>
+#include <vector>
+#include <map>
+#include <climits>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#if defined(__AVX__) || defined(__SSE__)
+#include <immintrin.h>
+#endif
+
+#include "Simulation.h"
+
+using namespace std;
+
+/* Physics numbers */
+//Positions, speeds, sizes and everything the physics computes from them have the type real. It is float, unless the
+//game is built with -DFIXED_POINT_PHYSICS, which makes it a Q16.16 fixed point number (16 bits of fraction).
+//The fixed point results only depend on integer arithmetic, so the same inputs give bit-identical worlds with every
+//compiler, flag and machine (for replays and lockstep play). Results that overflow saturate instead of wrapping.
+//Angles are real degrees too, with sinDegrees/cosDegrees from a table, and the launch, the sleep timer and the stress
+//levels are worked out with them (See make check-fixed).
+#ifdef FIXED_POINT_PHYSICS
+#define FIXED_ONE 65536
+
+int fixedSaturate(long long v){
+    return (int)max((long long)INT_MIN,min(v,(long long)INT_MAX));
+}
+
+struct Fixed {
+    int raw; //The value times FIXED_ONE
+    Fixed() : raw(0) {}
+    Fixed(int v) : raw(fixedSaturate((long long)v*FIXED_ONE)) {}
+    Fixed(double v) : raw(fixedSaturate(llround(max(-32768.0,min(v,32768.0))*FIXED_ONE))) {}
+    Fixed(float v) : raw(Fixed((double)v).raw) {}
+    explicit operator float() const { return raw/(float)FIXED_ONE; }
+    explicit operator double() const { return raw/(double)FIXED_ONE; }
+    explicit operator int() const { return raw/FIXED_ONE; } //Towards zero, like a float
+};
+typedef struct Fixed Fixed;
+
+Fixed fixedRaw(long long raw){
+    Fixed f;
+    f.raw=fixedSaturate(raw);
+    return f;
+}
+
+Fixed operator+(Fixed a, Fixed b){ return fixedRaw((long long)a.raw+b.raw); }
+Fixed operator-(Fixed a, Fixed b){ return fixedRaw((long long)a.raw-b.raw); }
+Fixed operator-(Fixed a){ return fixedRaw(-(long long)a.raw); }
+Fixed operator*(Fixed a, Fixed b){ return fixedRaw(((long long)a.raw*b.raw)>>16); }
+Fixed operator/(Fixed a, Fixed b){
+    if(b.raw==0)
+        return fixedRaw(a.raw<0 ? INT_MIN : INT_MAX);
+    return fixedRaw((long long)a.raw*FIXED_ONE/b.raw);
+}
+Fixed &operator+=(Fixed &a, Fixed b){ return a=a+b; }
+Fixed &operator-=(Fixed &a, Fixed b){ return a=a-b; }
+Fixed &operator*=(Fixed &a, Fixed b){ return a=a*b; }
+Fixed &operator/=(Fixed &a, Fixed b){ return a=a/b; }
+bool operator==(Fixed a, Fixed b){ return a.raw==b.raw; }
+bool operator!=(Fixed a, Fixed b){ return a.raw!=b.raw; }
+bool operator<(Fixed a, Fixed b){ return a.raw<b.raw; }
+bool operator>(Fixed a, Fixed b){ return a.raw>b.raw; }
+bool operator<=(Fixed a, Fixed b){ return a.raw<=b.raw; }
+bool operator>=(Fixed a, Fixed b){ return a.raw>=b.raw; }
+
+Fixed abs(Fixed a){
+    return a.raw<0 ? -a : a;
+}
+
+//Bit by bit integer square root of raw*FIXED_ONE
+Fixed sqrt(Fixed a){
+    if(a.raw<=0)
+        return Fixed();
+    unsigned long long value=(unsigned long long)a.raw<<16, root=0, bit=1ULL<<62;
+    while(bit>value)
+        bit>>=2;
+    while(bit!=0){
+        if(value>=root+bit){
+            value-=root+bit;
+            root=(root>>1)+bit;
+        }
+        else
+            root>>=1;
+        bit>>=2;
+    }
+    return fixedRaw(root);
+}
+
+Fixed fmod(Fixed a, Fixed b){
+    if(b.raw==0)
+        return Fixed();
+    return fixedRaw(a.raw%b.raw); //Keeps the sign of a, like fmod
+}
+
+//sin of the whole degrees from 0 to 90 times FIXED_ONE, written out so no sin of a library is involved
+const int fixed_sine[91]={
+    0,1144,2287,3430,4572,5712,6850,7987,9121,10252,
+    11380,12505,13626,14742,15855,16962,18064,19161,20252,21336,
+    22415,23486,24550,25607,26656,27697,28729,29753,30767,31772,
+    32768,33754,34729,35693,36647,37590,38521,39441,40348,41243,
+    42126,42995,43852,44695,45525,46341,47143,47930,48703,49461,
+    50203,50931,51643,52339,53020,53684,54332,54963,55578,56175,
+    56756,57319,57865,58393,58903,59396,59870,60326,60764,61183,
+    61584,61966,62328,62672,62997,63303,63589,63856,64104,64332,
+    64540,64729,64898,65048,65177,65287,65376,65446,65496,65526,
+    65536};
+
+//Of an angle in degrees, from the table and linear in between two whole degrees
+Fixed sinDegrees(Fixed degrees){
+    long long turn=360LL*FIXED_ONE;
+    long long angle=((long long)degrees.raw%turn+turn)%turn;
+    int sign=1;
+    if(angle>=turn/2){
+        angle-=turn/2;
+        sign=-1;
+    }
+    if(angle>90LL*FIXED_ONE)
+        angle=180LL*FIXED_ONE-angle;
+    int whole=angle/FIXED_ONE, fraction=angle%FIXED_ONE;
+    long long value=fixed_sine[whole];
+    if(whole<90)
+        value+=((long long)(fixed_sine[whole+1]-fixed_sine[whole])*fraction)/FIXED_ONE;
+    return fixedRaw(sign*value);
+}
+
+Fixed cosDegrees(Fixed degrees){
+    return sinDegrees(degrees+Fixed(90));
+}
+
+typedef Fixed real;
+#else
+typedef float real;
+
+real sinDegrees(real degrees){
+    return sin(degrees*M_PI/180);
+}
+
+real cosDegrees(real degrees){
+    return cos(degrees*M_PI/180);
+}
+#endif
+
+//Length of (dx,dy) without squaring large values (which would overflow a fixed point number)
+real length(real dx, real dy){
+    real m=max(abs(dx),abs(dy));
+    if(m==0)
+        return m;
+    dx/=m;
+    dy/=m;
+    return m*sqrt(dx*dx+dy*dy);
+}
+
+int player_score=0;
+int player_status=0; //0 is ready to play, 1 is not ready yet
+int player_reset_timer=0;
+real gravity = 1;
+real airResistance = 0.2/15;
+real play_top=250, play_bottom=-265; //Bodies are kept between these heights (below the roof and above the floor)
+ScorePopup score_popup={};
+
+/* Body store - Physics state of every body of the level */
+//The physics fields live in parallel arrays (structure of arrays) so the integrator and the collision code can walk them linearly.
+//A body is referred to by its integer handle (the index into the arrays). Handles are stable, a destroyed body only loses BODY_ALIVE.
+//Handles are given out in the lexicographic order of the names, so walking the handles visits bodies in the same order as the map.
+//The name map is only used while loading the level. The BODY_ flags are in Simulation.h.
+
+//Short lists of handles kept for every body, see Body links
+struct LinkLists {
+    vector<int> start; //First slot of the list of every body
+    vector<int> room; //Slots of every body
+    vector<int> count; //Slots in use of every body
+    vector<int> slots; //The lists of all the bodies
+};
+typedef struct LinkLists LinkLists;
+
+struct BodyStore {
+    vector<real> x,y;
+    vector<real> prev_x,prev_y; //Position at the start of the last physics step (for render interpolation)
+    vector<real> x_speed,y_speed;
+    vector<real> width,height;
+    vector<real> radius; //Of the bounding circle (See overlapBodies)
+    vector<real> bounds_width,bounds_height; //Axis aligned box around the body as it is turned (See updateBounds)
+    vector<int> exact; //1 for circles and turned boxes, which are collided with overlapBodies
+    vector<real> weight;
+    vector<real> friction;
+    vector<int> flags;
+    vector<int> health;
+    vector<int> rest_steps; //Steps the body has been at rest in a row
+    vector<int> island; //Island the body belonged to when it last moved
+    LinkLists supported_by; //Bodies this body rests on
+    LinkLists supporting; //Bodies resting on this body
+    vector<real> angle; //Degrees, only changed by the topple animation
+    vector<real> rem_angle; //The remaining angle to finish the topple animation
+    vector<int> rotating; //1 while toppling over
+    vector<int> direction; //0 for clockwise and 1 for anticlockwise
+    vector<BodyShape> shape;
+    int count;
+};
+typedef struct BodyStore BodyStore;
+
+BodyStore bodies;
+map <string, int> bodyNames; //Only used while loading the level
+int body_cannonball=-1;
+int body_springbase1=-1;
+int body_springbase2=-1;
+int body_springbase3=-1;
+
+//A body of the level as it was created, loadBodies moves it into the body store
+struct BodyDef {
+    BodyShape shape;
+    float x,y;
+    float weight;
+    float friction; //Value from 0 to 1
+    int fixed;
+};
+typedef struct BodyDef BodyDef;
+
+map <string, BodyDef> level_bodies;
+vector<Pickup> pickups; //Coins first, then goals, each in the order of their names
+
+
+//Bounding box tests of the box col against the box my, given as centre and size
+int checkCollisionRight(real col_x, real col_y, real col_width, real col_height, real my_x, real my_y, real my_width, real my_height){
+    if(col_x>my_x && col_y+col_height/2>my_y-my_height/2 && col_y-col_height/2<my_y+my_height/2 && col_x-col_width/2<my_x+my_width/2 && col_x+col_width/2>my_x-my_width/2){
+        return 1;
+    }
+    return 0;
+}
+
+int checkCollisionLeft(real col_x, real col_y, real col_width, real col_height, real my_x, real my_y, real my_width, real my_height){
+    if(col_x<my_x && col_y+col_height/2>my_y-my_height/2 && col_y-col_height/2<my_y+my_height/2 && col_x+col_width/2>my_x-my_width/2 && col_x-col_width/2<my_x+my_width/2){
+        return 1;
+    }
+    return 0;
+}
+
+int checkCollisionTop(real col_x, real col_y, real col_width, real col_height, real my_x, real my_y, real my_width, real my_height){
+    if(col_y>my_y && col_x+col_width/2>my_x-my_width/2 && col_x-col_width/2<my_x+my_width/2 && col_y-col_height/2<my_y+my_height/2 && col_y+col_height/2>my_y-my_height/2){
+        return 1;
+    }
+    return 0;
+}
+
+int checkCollisionBottom(real col_x, real col_y, real col_width, real col_height, real my_x, real my_y, real my_width, real my_height){
+    if(col_y<my_y && col_x+col_width/2>my_x-my_width/2 && col_x-col_width/2<my_x+my_width/2 && col_y+col_height/2>my_y-my_height/2 && col_y-col_height/2<my_y+my_height/2){
+        return 1;
+    }
+    return 0;
+}
+
+//Same tests between two bodies of the body store
+int checkCollisionRight(int col_body, int my_body){
+    return checkCollisionRight(bodies.x[col_body],bodies.y[col_body],bodies.width[col_body],bodies.height[col_body],bodies.x[my_body],bodies.y[my_body],bodies.width[my_body],bodies.height[my_body]);
+}
+
+int checkCollisionLeft(int col_body, int my_body){
+    return checkCollisionLeft(bodies.x[col_body],bodies.y[col_body],bodies.width[col_body],bodies.height[col_body],bodies.x[my_body],bodies.y[my_body],bodies.width[my_body],bodies.height[my_body]);
+}
+
+int checkCollisionTop(int col_body, int my_body){
+    return checkCollisionTop(bodies.x[col_body],bodies.y[col_body],bodies.width[col_body],bodies.height[col_body],bodies.x[my_body],bodies.y[my_body],bodies.width[my_body],bodies.height[my_body]);
+}
+
+int checkCollisionBottom(int col_body, int my_body){
+    return checkCollisionBottom(bodies.x[col_body],bodies.y[col_body],bodies.width[col_body],bodies.height[col_body],bodies.x[my_body],bodies.y[my_body],bodies.width[my_body],bodies.height[my_body]);
+}
+
+/* Narrowphase - Separating axis tests */
+//Crates and pigs rotate while they topple over (angle), so a box isn't always axis aligned. The grid and the batched
+//tests use the axis aligned box around a rotated body (boundsWidth/boundsHeight), and every pair with a rotated box or
+//a circle in it is then tested exactly by overlapBodies: boxes against boxes on the 4 edge normals (separating axis
+//test), circles against the closest point of a box and circles against circles. Pairs whose bounding circles don't
+//touch are rejected before any of that. Pairs of axis aligned boxes keep the tests above, which are exact for them.
+int isCircle(int body){
+    return bodies.shape[body].type==SHAPE_CIRCLE;
+}
+
+//Turned away from its axes (a box turned by 180 degrees is the same box again)
+int isRotated(int body){
+    return bodies.angle[body]!=0 && !isCircle(body) && fmod(bodies.angle[body],real(180))!=0;
+}
+
+//Unit edge normals of a box, rotated by its angle
+void bodyAxes(int body, real axes[2][2]){
+    axes[0][0]=cosDegrees(bodies.angle[body]);
+    axes[0][1]=sinDegrees(bodies.angle[body]);
+    axes[1][0]=-axes[0][1];
+    axes[1][1]=axes[0][0];
+}
+
+//Call after the angle of a body changed
+void updateBounds(int body){
+    bodies.exact[body]=isCircle(body) || isRotated(body);
+    if(!isRotated(body)){
+        bodies.bounds_width[body]=bodies.width[body];
+        bodies.bounds_height[body]=bodies.height[body];
+        return;
+    }
+    real axes[2][2];
+    bodyAxes(body,axes);
+    bodies.bounds_width[body]=abs(axes[0][0])*bodies.width[body]+abs(axes[1][0])*bodies.height[body];
+    bodies.bounds_height[body]=abs(axes[0][1])*bodies.width[body]+abs(axes[1][1])*bodies.height[body];
+}
+
+//Size of the axis aligned box around a body
+real boundsWidth(int body){
+    return bodies.bounds_width[body];
+}
+
+real boundsHeight(int body){
+    return bodies.bounds_height[body];
+}
+
+int needsExactTest(int a, int b){
+    return bodies.exact[a] || bodies.exact[b];
+}
+
+real dot(const real a[2], const real b[2]){
+    return a[0]*b[0]+a[1]*b[1];
+}
+
+//Half the width of a box measured along an axis
+real boxExtent(int body, const real axes[2][2], const real axis[2]){
+    return bodies.width[body]/2*abs(dot(axes[0],axis))+bodies.height[body]/2*abs(dot(axes[1],axis));
+}
+
+int overlapBoxes(int a, int b, real normal[2], real &depth, real a_dy){
+    real axes_a[2][2], axes_b[2][2];
+    bodyAxes(a,axes_a);
+    bodyAxes(b,axes_b);
+    real offset[2]={bodies.x[a]-bodies.x[b],bodies.y[a]+a_dy-bodies.y[b]};
+    for(int i=0;i<4;i++){
+        const real *axis = i<2 ? axes_a[i] : axes_b[i-2];
+        real distance=dot(offset,axis);
+        real overlap=boxExtent(a,axes_a,axis)+boxExtent(b,axes_b,axis)-abs(distance);
+        if(overlap<=0) //Separated along this axis
+            return 0;
+        if(i==0 || overlap<depth){
+            depth=overlap;
+            normal[0] = distance<0 ? -axis[0] : axis[0];
+            normal[1] = distance<0 ? -axis[1] : axis[1];
+        }
+    }
+    return 1;
+}
+
+int overlapCircleBox(int circle, int box, real normal[2], real &depth, real circle_dy){
+    real axes[2][2];
+    bodyAxes(box,axes);
+    real offset[2]={bodies.x[circle]-bodies.x[box],bodies.y[circle]+circle_dy-bodies.y[box]};
+    real local[2]={dot(offset,axes[0]),dot(offset,axes[1])}; //Centre of the circle in the frame of the box
+    real half[2]={bodies.width[box]/2,bodies.height[box]/2};
+    real radius=bodies.radius[circle];
+    if(abs(local[0])<=half[0] && abs(local[1])<=half[1]){ //Centre inside the box, out through the nearest edge
+        int axis = half[0]-abs(local[0])<half[1]-abs(local[1]) ? 0 : 1;
+        depth=half[axis]-abs(local[axis])+radius;
+        normal[0] = local[axis]<0 ? -axes[axis][0] : axes[axis][0];
+        normal[1] = local[axis]<0 ? -axes[axis][1] : axes[axis][1];
+        return 1;
+    }
+    real outside[2]={local[0]-max(-half[0],min(local[0],half[0])),local[1]-max(-half[1],min(local[1],half[1]))};
+    real distance=length(outside[0],outside[1]);
+    if(distance>=radius)
+        return 0;
+    depth=radius-distance;
+    outside[0]/=distance;
+    outside[1]/=distance;
+    normal[0]=outside[0]*axes[0][0]+outside[1]*axes[1][0];
+    normal[1]=outside[0]*axes[0][1]+outside[1]*axes[1][1];
+    return 1;
+}
+
+//1 if the bodies overlap, with the direction to push a out of b (unit length) and how far. a_dy tests a as if it
+//was moved up by that much (See restsOn).
+int overlapBodies(int a, int b, real normal[2], real &depth, real a_dy=0){
+    real dx=bodies.x[a]-bodies.x[b], dy=bodies.y[a]+a_dy-bodies.y[b];
+    real reach=bodies.radius[a]+bodies.radius[b];
+    if(abs(dx)>=reach || abs(dy)>=reach)
+        return 0;
+    real distance=length(dx,dy);
+    if(distance>=reach)
+        return 0;
+    if(isCircle(a) && isCircle(b)){
+        depth=reach-distance;
+        normal[0] = distance==0 ? real(0) : dx/distance;
+        normal[1] = distance==0 ? real(1) : dy/distance;
+        return 1;
+    }
+    if(isCircle(a))
+        return overlapCircleBox(a,b,normal,depth,a_dy);
+    if(isCircle(b)){
+        int hit=overlapCircleBox(b,a,normal,depth,-a_dy);
+        normal[0]=-normal[0];
+        normal[1]=-normal[1];
+        return hit;
+    }
+    return overlapBoxes(a,b,normal,depth,a_dy);
+}
+
+//An exact overlap of the moved body with col that stops the move by (dx,dy). The contact is along the axis the normal
+//is closest to, and body has to move push along it (in the direction of sign) to get out.
+int exactContact(int body, int col, real dx, real dy, int &axis, int &sign, real &push){
+    real normal[2], depth;
+    if(!overlapBodies(body,col,normal,depth))
+        return 0;
+    axis = abs(normal[0])>abs(normal[1]) ? 0 : 1;
+    sign = normal[axis]<0 ? -1 : 1;
+    if(axis==0 ? !((dx>0 && sign<0) || (dx<0 && sign>0)) : !((dy>0 && sign<0) || (dy<=0 && sign>0)))
+        return 0;
+    push=depth/abs(normal[axis]);
+    return 1;
+}
+
+/* Batched bounding box tests */
+//Tests one moving box against a packed array of boxes at once, 8 boxes per instruction when compiled with AVX
+//(-mavx), 4 with SSE, one at a time otherwise. Bit i of the right/left/top/bottom masks is set exactly when
+//checkCollisionRight/Left/Top/Bottom(box i, moving box) would return 1. Each mask holds (count+31)/32 words.
+struct PackedBoxes {
+    vector<real> x,y,width,height; //Padded with empty boxes to a multiple of 8
+    int count;
+};
+typedef struct PackedBoxes PackedBoxes;
+
+void packBoxes(const vector<int> &list, PackedBoxes &boxes){
+    int padded=(list.size()+7)&~7;
+    boxes.count=list.size();
+    boxes.x.assign(padded,0);
+    boxes.y.assign(padded,0);
+    boxes.width.assign(padded,0);
+    boxes.height.assign(padded,0);
+    for(int i=0;i<list.size();i++){
+        boxes.x[i]=bodies.x[list[i]];
+        boxes.y[i]=bodies.y[list[i]];
+        boxes.width[i]=boundsWidth(list[i]);
+        boxes.height[i]=boundsHeight(list[i]);
+    }
+}
+
+void collisionMasks(real my_x, real my_y, real my_width, real my_height, const PackedBoxes &boxes, unsigned *right, unsigned *left, unsigned *top, unsigned *bottom){
+    int words=(boxes.count+31)/32;
+    for(int w=0;w<words;w++){
+        right[w]=0;
+        left[w]=0;
+        top[w]=0;
+        bottom[w]=0;
+    }
+    int i=0;
+#if defined(FIXED_POINT_PHYSICS) && defined(__SSE2__)
+    //Fixed point numbers compare like the integers they are stored as
+    __m128i mx=_mm_set1_epi32(my_x.raw), my=_mm_set1_epi32(my_y.raw);
+    __m128i my_left=_mm_set1_epi32((my_x-my_width/2).raw), my_right=_mm_set1_epi32((my_x+my_width/2).raw);
+    __m128i my_bottom=_mm_set1_epi32((my_y-my_height/2).raw), my_top=_mm_set1_epi32((my_y+my_height/2).raw);
+    for(;i<boxes.count;i+=4){
+        __m128i cx=_mm_loadu_si128((const __m128i*)&boxes.x[i]);
+        __m128i cy=_mm_loadu_si128((const __m128i*)&boxes.y[i]);
+        __m128i half_width=_mm_srai_epi32(_mm_loadu_si128((const __m128i*)&boxes.width[i]),1); //Sizes are never negative
+        __m128i half_height=_mm_srai_epi32(_mm_loadu_si128((const __m128i*)&boxes.height[i]),1);
+        __m128i overlap=_mm_and_si128(
+                _mm_and_si128(_mm_cmpgt_epi32(_mm_add_epi32(cy,half_height),my_bottom),_mm_cmplt_epi32(_mm_sub_epi32(cy,half_height),my_top)),
+                _mm_and_si128(_mm_cmplt_epi32(_mm_sub_epi32(cx,half_width),my_right),_mm_cmpgt_epi32(_mm_add_epi32(cx,half_width),my_left)));
+        int shift=i&31;
+        right[i>>5]|=(unsigned)_mm_movemask_ps(_mm_castsi128_ps(_mm_and_si128(overlap,_mm_cmpgt_epi32(cx,mx))))<<shift;
+        left[i>>5]|=(unsigned)_mm_movemask_ps(_mm_castsi128_ps(_mm_and_si128(overlap,_mm_cmplt_epi32(cx,mx))))<<shift;
+        top[i>>5]|=(unsigned)_mm_movemask_ps(_mm_castsi128_ps(_mm_and_si128(overlap,_mm_cmpgt_epi32(cy,my))))<<shift;
+        bottom[i>>5]|=(unsigned)_mm_movemask_ps(_mm_castsi128_ps(_mm_and_si128(overlap,_mm_cmplt_epi32(cy,my))))<<shift;
+    }
+#elif defined(__AVX__) && !defined(FIXED_POINT_PHYSICS)
+    __m256 half=_mm256_set1_ps(0.5f);
+    __m256 mx=_mm256_set1_ps(my_x), my=_mm256_set1_ps(my_y);
+    __m256 my_left=_mm256_set1_ps(my_x-my_width/2), my_right=_mm256_set1_ps(my_x+my_width/2);
+    __m256 my_bottom=_mm256_set1_ps(my_y-my_height/2), my_top=_mm256_set1_ps(my_y+my_height/2);
+    for(;i<boxes.count;i+=8){
+        __m256 cx=_mm256_loadu_ps(&boxes.x[i]);
+        __m256 cy=_mm256_loadu_ps(&boxes.y[i]);
+        __m256 half_width=_mm256_mul_ps(_mm256_loadu_ps(&boxes.width[i]),half);
+        __m256 half_height=_mm256_mul_ps(_mm256_loadu_ps(&boxes.height[i]),half);
+        __m256 overlap=_mm256_and_ps(
+                _mm256_and_ps(_mm256_cmp_ps(_mm256_add_ps(cy,half_height),my_bottom,_CMP_GT_OQ),_mm256_cmp_ps(_mm256_sub_ps(cy,half_height),my_top,_CMP_LT_OQ)),
+                _mm256_and_ps(_mm256_cmp_ps(_mm256_sub_ps(cx,half_width),my_right,_CMP_LT_OQ),_mm256_cmp_ps(_mm256_add_ps(cx,half_width),my_left,_CMP_GT_OQ)));
+        int shift=i&31;
+        right[i>>5]|=(unsigned)_mm256_movemask_ps(_mm256_and_ps(overlap,_mm256_cmp_ps(cx,mx,_CMP_GT_OQ)))<<shift;
+        left[i>>5]|=(unsigned)_mm256_movemask_ps(_mm256_and_ps(overlap,_mm256_cmp_ps(cx,mx,_CMP_LT_OQ)))<<shift;
+        top[i>>5]|=(unsigned)_mm256_movemask_ps(_mm256_and_ps(overlap,_mm256_cmp_ps(cy,my,_CMP_GT_OQ)))<<shift;
+        bottom[i>>5]|=(unsigned)_mm256_movemask_ps(_mm256_and_ps(overlap,_mm256_cmp_ps(cy,my,_CMP_LT_OQ)))<<shift;
+    }
+#elif defined(__SSE__) && !defined(FIXED_POINT_PHYSICS)
+    __m128 half=_mm_set1_ps(0.5f);
+    __m128 mx=_mm_set1_ps(my_x), my=_mm_set1_ps(my_y);
+    __m128 my_left=_mm_set1_ps(my_x-my_width/2), my_right=_mm_set1_ps(my_x+my_width/2);
+    __m128 my_bottom=_mm_set1_ps(my_y-my_height/2), my_top=_mm_set1_ps(my_y+my_height/2);
+    for(;i<boxes.count;i+=4){
+        __m128 cx=_mm_loadu_ps(&boxes.x[i]);
+        __m128 cy=_mm_loadu_ps(&boxes.y[i]);
+        __m128 half_width=_mm_mul_ps(_mm_loadu_ps(&boxes.width[i]),half);
+        __m128 half_height=_mm_mul_ps(_mm_loadu_ps(&boxes.height[i]),half);
+        __m128 overlap=_mm_and_ps(
+                _mm_and_ps(_mm_cmpgt_ps(_mm_add_ps(cy,half_height),my_bottom),_mm_cmplt_ps(_mm_sub_ps(cy,half_height),my_top)),
+                _mm_and_ps(_mm_cmplt_ps(_mm_sub_ps(cx,half_width),my_right),_mm_cmpgt_ps(_mm_add_ps(cx,half_width),my_left)));
+        int shift=i&31;
+        right[i>>5]|=(unsigned)_mm_movemask_ps(_mm_and_ps(overlap,_mm_cmpgt_ps(cx,mx)))<<shift;
+        left[i>>5]|=(unsigned)_mm_movemask_ps(_mm_and_ps(overlap,_mm_cmplt_ps(cx,mx)))<<shift;
+        top[i>>5]|=(unsigned)_mm_movemask_ps(_mm_and_ps(overlap,_mm_cmpgt_ps(cy,my)))<<shift;
+        bottom[i>>5]|=(unsigned)_mm_movemask_ps(_mm_and_ps(overlap,_mm_cmplt_ps(cy,my)))<<shift;
+    }
+#else
+    for(;i<boxes.count;i++){
+        unsigned bit=1u<<(i&31);
+        if(checkCollisionRight(boxes.x[i],boxes.y[i],boxes.width[i],boxes.height[i],my_x,my_y,my_width,my_height))
+            right[i>>5]|=bit;
+        if(checkCollisionLeft(boxes.x[i],boxes.y[i],boxes.width[i],boxes.height[i],my_x,my_y,my_width,my_height))
+            left[i>>5]|=bit;
+        if(checkCollisionTop(boxes.x[i],boxes.y[i],boxes.width[i],boxes.height[i],my_x,my_y,my_width,my_height))
+            top[i>>5]|=bit;
+        if(checkCollisionBottom(boxes.x[i],boxes.y[i],boxes.width[i],boxes.height[i],my_x,my_y,my_width,my_height))
+            bottom[i>>5]|=bit;
+    }
+#endif
+    if(boxes.count&31){ //Clear the padding
+        unsigned valid=(1u<<(boxes.count&31))-1;
+        right[words-1]&=valid;
+        left[words-1]&=valid;
+        top[words-1]&=valid;
+        bottom[words-1]&=valid;
+    }
+}
+
+//Index of the first set bit at or after from, count if there is none
+int nextSetBit(const unsigned *mask, int from, int count){
+    while(from<count){
+        unsigned word=mask[from>>5]>>(from&31);
+        if(word)
+            return from+__builtin_ctz(word);
+        from=(from|31)+1;
+    }
+    return count;
+}
+
+/* Contact solver - Contacts */
+//A pair of touching bodies found by checkCollision. body was pushed out of col along the normal, which points along
+//axis (0 for x, 1 for y) in the direction of sign. The accumulated impulses are kept from one step to the next.
+struct SolverContact {
+    int body,col;
+    int axis,sign;
+    real normal_impulse; //Accumulated, never negative (contacts only push)
+    real tangent_impulse; //Accumulated, at most friction times normal_impulse either way
+    real mass; //Effective mass along the normal (and the tangent, the bodies don't rotate)
+    real friction;
+    real target; //Normal speed the solver aims for, positive if the bodies bounce apart
+    real approach; //Normal speed before the solve, negative while they move into each other
+};
+typedef struct SolverContact SolverContact;
+
+/* Island stepping - State shared with the worker threads */
+//With physics_threads>1 the awake bodies are split into groups that can't reach each other during a step (See
+//stepIslands) and each group is stepped on a worker thread. While a thread steps a group, step_group points to it,
+//and whatever two groups could both touch (contacts, counters, the supporter lists of fixed bodies, the grid) is
+//recorded in the group instead and merged once all the workers are done, in the order the bodies would have been
+//stepped in.
+struct SupportEdit {
+    int body;
+    int supporter;
+    int added; //1 for addSupport, 0 for removeSupport
+};
+typedef struct SupportEdit SupportEdit;
+
+//Where the records of a member start in the lists of its group, its records end where the next member's start
+struct StepMark {
+    int body;
+    int contacts,support_edits,events;
+};
+typedef struct StepMark StepMark;
+
+//Grid cells a member moved to, the grid itself only changes when the groups are merged (See Broadphase)
+struct GridChange {
+    int body;
+    int x0,y0,x1,y1;
+    int valid; //0 if the body was removed from the grid
+};
+typedef struct GridChange GridChange;
+
+//State of a member before its group was stepped, to undo the group (See stepIslands)
+struct SavedBody {
+    real x,y,x_speed,y_speed;
+    real angle,rem_angle,bounds_width,bounds_height;
+    int flags,health,rest_steps,exact,rotating,direction;
+};
+typedef struct SavedBody SavedBody;
+
+struct IslandGroup {
+    int id; //Lowest handle in the group
+    vector<int> members; //Handles in order
+    vector< pair<int,int> > contacts;
+    vector<SupportEdit> support_edits; //Changes to the supporter lists of fixed bodies
+    vector<CollisionEvent> events;
+    vector<SolverContact> solver_contacts;
+    vector<StepMark> marks; //One per member the worker stepped
+    vector<GridChange> grid_changes; //One per member that changed cells
+    vector<int> grid_heads; //Hashed cell -> last of grid_entries added for it, -1 if none
+    vector< pair<int,int> > grid_entries; //(member,next entry) for every cell the members moved into
+    vector<SavedBody> saved; //One per member
+    vector<int> saved_links; //The lists of every member, each list is its length followed by its handles
+    vector<int> saved_sensors; //Sensors enabled and pickups alive, if a member has BODY_TRIGGERS
+    int stopped; //1 if a member had to stop, the group is then undone and stepped again (See stepIslands)
+    int stop_x0,stop_y0,stop_x1,stop_y1; //Cells the member needed
+    LinkLists *full_links; //List that ran out of room, only the main thread can make more (See linkAdd)
+    int full_body;
+    PhysicsStats stats; //Counters and timings of the group
+};
+typedef struct IslandGroup IslandGroup;
+
+thread_local IslandGroup *step_group=NULL; //Group stepped by this thread, NULL when stepping serially
+vector<int> body_group; //id of the group every body is stepped in, -1 if it is in none (only valid in stepIslands)
+
+/* Step statistics */
+//Every step counts what it did (See PhysicsStats), cleared at the start of stepPhysics. Reading the clock costs about
+//as much as a collision test, so the phases are only timed while physics_timings is set.
+//Workers count into their group, which is added to physics_stats when the groups are merged.
+PhysicsStats physics_stats;
+int physics_timings=0;
+
+PhysicsStats &stepStats(){
+    return step_group!=NULL ? step_group->stats : physics_stats;
+}
+
+void addStats(PhysicsStats &to, const PhysicsStats &from){
+    to.bodies_integrated+=from.bodies_integrated;
+    to.ground_probes+=from.ground_probes;
+    to.pairs_tested+=from.pairs_tested;
+    to.pairs_culled+=from.pairs_culled;
+    to.contacts_resolved+=from.contacts_resolved;
+    to.destroyed+=from.destroyed;
+    to.integration_us+=from.integration_us;
+    to.broadphase_us+=from.broadphase_us;
+    to.narrowphase_us+=from.narrowphase_us;
+    to.response_us+=from.response_us;
+    to.step_us+=from.step_us;
+}
+
+chrono::steady_clock::time_point stepClock(){
+    return physics_timings ? chrono::steady_clock::now() : chrono::steady_clock::time_point();
+}
+
+//Microseconds since lap, which is moved up to now so the next phase is timed from there
+double lapMicroseconds(chrono::steady_clock::time_point &lap){
+    if(!physics_timings)
+        return 0;
+    chrono::steady_clock::time_point now = chrono::steady_clock::now();
+    double us = chrono::duration<double,micro>(now-lap).count();
+    lap=now;
+    return us;
+}
+
+/* Collision events */
+//The collisions and sensors only change the physics state (speeds, health, what is alive). Everything else they
+//cause, the points, the score popup and the messages, is recorded as an event in step_events and applied once the
+//step is done by applyEvents. The events of the last step can be read with stepEvents (to log or replay them).
+vector<CollisionEvent> step_events;
+
+void pushEvent(int type, int body, int other, float x, float y, int value){
+    CollisionEvent event = {type,body,other,x,y,value};
+    if(step_group!=NULL)
+        step_group->events.push_back(event);
+    else
+        step_events.push_back(event);
+}
+
+/* Contact solver */
+//checkCollision only pushes a moved body out of what it hit and records the contact. Once every body has moved,
+//solveContacts works out the speeds with sequential impulses: each contact in turn gets the impulse that stops the
+//bodies moving into each other (or bounces them apart) and the friction impulse that stops them sliding, limited to
+//friction times the normal impulse. Repeating this solver_iterations times converges for stacks, where every contact
+//depends on its neighbours. A contact found again in the next step starts from the impulses it ended with
+//(warm starting), so a resting stack is solved in the first iteration and comes to rest without jittering. The solver
+//never stops a body itself, a body that got moving is stepped until the sleep check finds its island at rest.
+//The contacts are solved in the order of their bodies, so every thread count gives the same speeds.
+#define SOLVER_REST_SPEED 7.5 //Bodies hitting each other slower than this don't bounce
+
+int solver_iterations=8;
+real restitution=0.5; //Fraction of the normal speed kept when bouncing
+vector<SolverContact> solver_contacts; //Contacts of this step
+vector<SolverContact> contact_cache; //Contacts of the last step, for warm starting
+
+void addSolverContact(int body, int col, int axis, int sign){
+    SolverContact contact = {};
+    contact.body=body;
+    contact.col=col;
+    contact.axis=axis;
+    contact.sign=sign;
+    if(step_group!=NULL)
+        step_group->solver_contacts.push_back(contact);
+    else
+        solver_contacts.push_back(contact);
+}
+
+bool contactBefore(const SolverContact &a, const SolverContact &b){
+    if(a.body!=b.body)
+        return a.body<b.body;
+    if(a.col!=b.col)
+        return a.col<b.col;
+    if(a.axis!=b.axis)
+        return a.axis<b.axis;
+    return a.sign<b.sign;
+}
+
+bool sameContact(const SolverContact &a, const SolverContact &b){
+    return a.body==b.body && a.col==b.col && a.axis==b.axis && a.sign==b.sign;
+}
+
+real inverseMass(int body){
+    if((bodies.flags[body]&BODY_FIXED) || bodies.weight[body]==0)
+        return 0;
+    return 1/bodies.weight[body];
+}
+
+vector<real> &axisSpeeds(int axis){
+    return axis==0 ? bodies.x_speed : bodies.y_speed;
+}
+
+//Speed of body relative to col along an axis
+real relativeSpeed(const SolverContact &contact, int axis){
+    vector<real> &speed = axisSpeeds(axis);
+    return speed[contact.body]-speed[contact.col];
+}
+
+void applyImpulse(const SolverContact &contact, int axis, real impulse){
+    vector<real> &speed = axisSpeeds(axis);
+    speed[contact.body]+=impulse*inverseMass(contact.body);
+    speed[contact.col]-=impulse*inverseMass(contact.col);
+}
+
+void solveContacts(){
+    sort(solver_contacts.begin(),solver_contacts.end(),contactBefore);
+    solver_contacts.erase(unique(solver_contacts.begin(),solver_contacts.end(),sameContact),solver_contacts.end());
+
+    //Prepare every contact before any impulse changes the speeds it is measured with
+    for(int i=0;i<solver_contacts.size();i++){
+        SolverContact &contact = solver_contacts[i];
+        real inverse=inverseMass(contact.body)+inverseMass(contact.col);
+        contact.mass = inverse==0 ? real(0) : 1/inverse;
+        contact.friction=sqrt(bodies.friction[contact.body]*bodies.friction[contact.col]);
+        contact.approach=contact.sign*relativeSpeed(contact,contact.axis);
+        contact.target = contact.approach<-SOLVER_REST_SPEED ? -restitution*contact.approach : real(0);
+    }
+
+    //Warm start them with the impulses they had in the last step
+    int cached=0;
+    for(int i=0;i<solver_contacts.size();i++){
+        SolverContact &contact = solver_contacts[i];
+        while(cached<contact_cache.size() && contactBefore(contact_cache[cached],contact))
+            cached++;
+        if(cached<contact_cache.size() && sameContact(contact_cache[cached],contact) && contact.target==0){ //A bounce starts over
+            contact.normal_impulse=contact_cache[cached].normal_impulse;
+            contact.tangent_impulse=contact_cache[cached].tangent_impulse;
+            applyImpulse(contact,contact.axis,contact.sign*contact.normal_impulse);
+            applyImpulse(contact,1-contact.axis,contact.tangent_impulse);
+        }
+    }
+
+    for(int iteration=0;iteration<solver_iterations;iteration++){
+        for(int i=0;i<solver_contacts.size();i++){
+            SolverContact &contact = solver_contacts[i];
+            if(contact.mass==0)
+                continue;
+            //Normal impulse, the accumulated impulse may shrink but never pull the bodies together
+            real impulse=(contact.target-contact.sign*relativeSpeed(contact,contact.axis))*contact.mass;
+            real accumulated=max(contact.normal_impulse+impulse,real(0));
+            impulse=accumulated-contact.normal_impulse;
+            contact.normal_impulse=accumulated;
+            applyImpulse(contact,contact.axis,contact.sign*impulse);
+
+            //Coulomb friction along the other axis
+            real limit=contact.friction*contact.normal_impulse;
+            impulse=-relativeSpeed(contact,1-contact.axis)*contact.mass;
+            accumulated=max(-limit,min(contact.tangent_impulse+impulse,limit));
+            impulse=accumulated-contact.tangent_impulse;
+            contact.tangent_impulse=accumulated;
+            applyImpulse(contact,1-contact.axis,impulse);
+        }
+    }
+    contact_cache.swap(solver_contacts);
+    solver_contacts.clear();
+}
+
+/* Broadphase - Uniform grid spatial hash */
+//Every collidable body is stored in all the grid cells its bounding box touches.
+//Cells are hashed into buckets, so the world does not need to have fixed bounds. gridRebuild sizes the table to the
+//cells the bodies cover (at least GRID_MIN_BUCKETS), so a bucket holds about one cell whatever the size of the level.
+//The grid is built when the level is loaded and then updated incrementally whenever a body moves.
+//The worker threads only read it. The cells a member of their group moves to are queued in the group (grid_changes)
+//and written once all the workers are done, in handle order. Until then the group finds its moved members through
+//its own small hash of the cells they moved into (grid_heads), so its queries see what one thread would have seen.
+#define GRID_CELL_SIZE 64.0f
+#define GRID_MIN_BUCKETS 1024 //Must be a power of 2
+
+vector< vector<int> > grid_buckets(GRID_MIN_BUCKETS);
+int grid_bucket_mask=GRID_MIN_BUCKETS-1; //Number of buckets minus 1, it is a power of 2
+vector<int> grid_x0,grid_y0,grid_x1,grid_y1; //Cells of the grid each body is currently stored in
+vector<int> grid_valid; //1 if the above cells are stored in the grid
+vector<int> grid_pending; //Index in the grid_changes of its group while a worker steps the body, otherwise -1
+
+int gridCell(float v){
+    return (int)floor(v/GRID_CELL_SIZE);
+}
+
+#ifdef FIXED_POINT_PHYSICS
+int gridCell(Fixed v){
+    return v.raw>>22; //Cells are 64 units, 2^6 times 2^16
+}
+#endif
+
+int gridBucket(int cx, int cy){
+    return (int)(((unsigned)cx*73856093u ^ (unsigned)cy*19349663u) & grid_bucket_mask);
+}
+
+void gridUnlink(int body){
+    if(grid_valid[body]==0)
+        return;
+    for(int cx=grid_x0[body];cx<=grid_x1[body];cx++){
+        for(int cy=grid_y0[body];cy<=grid_y1[body];cy++){
+            vector<int> &bucket = grid_buckets[gridBucket(cx,cy)];
+            for(int i=0;i<bucket.size();i++){
+                if(bucket[i]==body){
+                    bucket[i]=bucket.back();
+                    bucket.pop_back();
+                    break;
+                }
+            }
+        }
+    }
+    grid_valid[body]=0;
+}
+
+void gridLink(int body, int x0, int y0, int x1, int y1){
+    grid_x0[body]=x0;
+    grid_y0[body]=y0;
+    grid_x1[body]=x1;
+    grid_y1[body]=y1;
+    for(int cx=x0;cx<=x1;cx++)
+        for(int cy=y0;cy<=y1;cy++)
+            grid_buckets[gridBucket(cx,cy)].push_back(body);
+    grid_valid[body]=1;
+}
+
+void gridInsert(int body){
+    real width=boundsWidth(body), height=boundsHeight(body);
+    gridLink(body,gridCell(bodies.x[body]-width/2),gridCell(bodies.y[body]-height/2),gridCell(bodies.x[body]+width/2),gridCell(bodies.y[body]+height/2));
+}
+
+//Queue new cells of a member of the group stepped by this thread
+void gridQueue(int body, int x0, int y0, int x1, int y1, int valid){
+    IslandGroup &group = *step_group;
+    int &pending = grid_pending[body];
+    if(pending==-1){
+        pending=group.grid_changes.size();
+        group.grid_changes.push_back(GridChange());
+    }
+    GridChange change = {body,x0,y0,x1,y1,valid};
+    group.grid_changes[pending]=change;
+    if(!valid)
+        return;
+    int mask=group.grid_heads.size()-1;
+    for(int cx=x0;cx<=x1;cx++){
+        for(int cy=y0;cy<=y1;cy++){
+            int &head = group.grid_heads[gridBucket(cx,cy)&mask];
+            group.grid_entries.push_back(make_pair(body,head));
+            head=group.grid_entries.size()-1;
+        }
+    }
+}
+
+void gridRemove(int body){
+    if(step_group!=NULL)
+        gridQueue(body,0,0,-1,-1,0);
+    else
+        gridUnlink(body);
+}
+
+//Call after a body moves. Only touches the grid if the body crossed into a different cell.
+void gridUpdate(int body){
+    if(bodies.height[body]==-1) //Triangles are never collided with
+        return;
+    real width=boundsWidth(body), height=boundsHeight(body);
+    int x0=gridCell(bodies.x[body]-width/2), x1=gridCell(bodies.x[body]+width/2);
+    int y0=gridCell(bodies.y[body]-height/2), y1=gridCell(bodies.y[body]+height/2);
+    if(step_group!=NULL){
+        int pending=grid_pending[body];
+        const GridChange now = pending!=-1 ? step_group->grid_changes[pending] : GridChange{body,grid_x0[body],grid_y0[body],grid_x1[body],grid_y1[body],grid_valid[body]};
+        if(now.valid==0 || now.x0!=x0 || now.x1!=x1 || now.y0!=y0 || now.y1!=y1)
+            gridQueue(body,x0,y0,x1,y1,1);
+        return;
+    }
+    if(grid_valid[body]==1 && grid_x0[body]==x0 && grid_x1[body]==x1 && grid_y0[body]==y0 && grid_y1[body]==y1)
+        return;
+    gridUnlink(body);
+    gridLink(body,x0,y0,x1,y1);
+}
+
+//Write the queued cells of a member into the grid
+void gridApply(const GridChange &change){
+    gridUnlink(change.body);
+    if(change.valid)
+        gridLink(change.body,change.x0,change.y0,change.x1,change.y1);
+    grid_pending[change.body]=-1;
+}
+
+//Forget the queued cells of a group
+void gridDiscard(IslandGroup &group){
+    for(int i=0;i<group.grid_changes.size();i++)
+        grid_pending[group.grid_changes[i].body]=-1;
+    group.grid_changes.clear();
+    group.grid_entries.clear();
+}
+
+void gridRebuild(){
+    long long cells=0;
+    for(int body=0;body<bodies.count;body++){
+        if((bodies.flags[body]&BODY_ALIVE)==0 || bodies.height[body]==-1)
+            continue;
+        real width=boundsWidth(body), height=boundsHeight(body);
+        cells+=(long long)(gridCell(bodies.x[body]+width/2)-gridCell(bodies.x[body]-width/2)+1)*(gridCell(bodies.y[body]+height/2)-gridCell(bodies.y[body]-height/2)+1);
+    }
+    int buckets=GRID_MIN_BUCKETS;
+    while(buckets<cells && buckets<(1<<24))
+        buckets*=2;
+    for(int i=0;i<grid_buckets.size();i++)
+        grid_buckets[i].clear();
+    grid_buckets.resize(buckets);
+    grid_bucket_mask=buckets-1;
+    grid_x0.resize(bodies.count);
+    grid_y0.resize(bodies.count);
+    grid_x1.resize(bodies.count);
+    grid_y1.resize(bodies.count);
+    grid_valid.assign(bodies.count,0);
+    grid_pending.assign(bodies.count,-1);
+    for(int body=0;body<bodies.count;body++){
+        if((bodies.flags[body]&BODY_ALIVE)==0 || bodies.height[body]==-1)
+            continue;
+        gridInsert(body);
+    }
+}
+
+//Collects every body whose cells overlap the box (x,y,width,height) grown by margin on each side.
+//The result is sorted by handle so that collisions resolve in the same order as walking all the bodies.
+void gridQuery(real x, real y, real width, real height, real margin_x, real margin_y, vector<int> &result){
+    static thread_local vector<int> query_stamps; //Last query of this thread that returned the body (to skip duplicates)
+    static thread_local int query_stamp=0;
+    query_stamps.resize(bodies.count,0);
+    query_stamp++;
+    result.clear();
+    IslandGroup *group = step_group;
+    int x0=gridCell(x-width/2-margin_x), x1=gridCell(x+width/2+margin_x);
+    int y0=gridCell(y-height/2-margin_y), y1=gridCell(y+height/2+margin_y);
+    for(int cx=x0;cx<=x1;cx++){
+        for(int cy=y0;cy<=y1;cy++){
+            vector<int> &bucket = grid_buckets[gridBucket(cx,cy)];
+            for(int i=0;i<bucket.size();i++){
+                int candidate = bucket[i];
+                if(query_stamps[candidate]==query_stamp)
+                    continue;
+                if(group!=NULL && body_group[candidate]==group->id && grid_pending[candidate]!=-1) //Found below
+                    continue;
+                //Buckets are shared by hashed cells, skip anything outside the queried cells
+                if(grid_x1[candidate]<x0 || grid_x0[candidate]>x1 || grid_y1[candidate]<y0 || grid_y0[candidate]>y1)
+                    continue;
+                query_stamps[candidate]=query_stamp;
+                result.push_back(candidate);
+            }
+            if(group==NULL)
+                continue;
+            //Members of this group that moved here during the step, with the cells they are in now
+            for(int e=group->grid_heads[gridBucket(cx,cy)&(group->grid_heads.size()-1)];e!=-1;e=group->grid_entries[e].second){
+                int candidate = group->grid_entries[e].first;
+                const GridChange &cells = group->grid_changes[grid_pending[candidate]];
+                if(query_stamps[candidate]==query_stamp || cells.valid==0)
+                    continue;
+                if(cells.x1<x0 || cells.x0>x1 || cells.y1<y0 || cells.y0>y1)
+                    continue;
+                query_stamps[candidate]=query_stamp;
+                result.push_back(candidate);
+            }
+        }
+    }
+    sort(result.begin(),result.end());
+}
+
+/* Sleeping bodies and islands */
+//A body that stays supported by something and below sleep_speed for sleep_delay seconds is at rest.
+//Bodies touching each other (the contacts of the last step) form an island, and an island only falls asleep once
+//all its bodies are at rest. Sleeping bodies are skipped by the physics completely, they only remain in the grid
+//as obstacles. The first collision with a sleeping body, or the death of one, wakes its whole island again.
+//Fixed bodies never sleep and never join islands (the floor would otherwise link everything together).
+real sleep_speed=2; //Units per 1/60th of a second
+int sleep_delay=250; //Milliseconds
+vector< pair<int,int> > step_contacts; //Pairs of non fixed bodies that touched during this step
+vector<int> island_parent; //Union find over the bodies, only valid while building the islands
+int bodies_awake=0; //Non fixed bodies that were simulated during the last step
+
+int isSupported(int body); //See Support graph
+
+void addContact(int a, int b){
+    if(step_group!=NULL)
+        step_group->contacts.push_back(make_pair(a,b));
+    else
+        step_contacts.push_back(make_pair(a,b));
+}
+
+void wakeBody(int body){
+    bodies.flags[body]&=~BODY_SLEEPING;
+    bodies.rest_steps[body]=0;
+}
+
+void wakeIsland(int island){
+    if(step_group!=NULL){ //The group holds the whole island, the other bodies belong to other threads
+        for(int i=0;i<step_group->members.size();i++){
+            int body=step_group->members[i];
+            if((bodies.flags[body]&BODY_SLEEPING) && bodies.island[body]==island)
+                wakeBody(body);
+        }
+        return;
+    }
+    for(int body=0;body<bodies.count;body++)
+        if((bodies.flags[body]&BODY_SLEEPING) && bodies.island[body]==island)
+            wakeBody(body);
+}
+
+int islandFind(int body){
+    while(island_parent[body]!=body){
+        island_parent[body]=island_parent[island_parent[body]];
+        body=island_parent[body];
+    }
+    return body;
+}
+
+void islandUnion(int a, int b){
+    a=islandFind(a);
+    b=islandFind(b);
+    if(a==b)
+        return;
+    //Keep the root of a sleeping island as the root so its sleeping bodies stay valid
+    if(bodies.flags[a]&BODY_SLEEPING)
+        island_parent[b]=a;
+    else
+        island_parent[a]=b;
+}
+
+//Group the contacts of this step into islands and put the islands that are completely at rest to sleep
+void updateSleep(){
+    int rest_needed=(sleep_delay*physics_hz+999)/1000; //Steps, rounded up
+    island_parent.resize(bodies.count);
+    for(int body=0;body<bodies.count;body++){
+        if(bodies.flags[body]&BODY_SLEEPING)
+            island_parent[body]=bodies.island[body];
+        else
+            island_parent[body]=body;
+    }
+    for(int i=0;i<step_contacts.size();i++)
+        islandUnion(step_contacts[i].first,step_contacts[i].second);
+
+    //Sleeping islands bridged by an awake body are now one island
+    for(int body=0;body<bodies.count;body++)
+        if((bodies.flags[body]&BODY_SLEEPING) && island_parent[bodies.island[body]]!=bodies.island[body])
+            bodies.island[body]=islandFind(body);
+
+    static vector<int> island_rested;
+    island_rested.assign(bodies.count,1);
+    bodies_awake=0;
+    for(int body=0;body<bodies.count;body++){
+        int flags=bodies.flags[body];
+        if((flags&BODY_ALIVE)==0 || (flags&BODY_FIXED) || (flags&BODY_SLEEPING))
+            continue;
+        bodies_awake++;
+        bodies.island[body]=islandFind(body);
+        if(((flags&BODY_IN_AIR)==0 || isSupported(body)) && bodies.rotating[body]==0 && abs(bodies.x_speed[body])<=sleep_speed && abs(bodies.y_speed[body])<=sleep_speed)
+            bodies.rest_steps[body]++;
+        else
+            bodies.rest_steps[body]=0;
+        if(body==body_cannonball && bodies.rest_steps[body]==1 && player_reset_timer==0 && player_status==1)
+            player_reset_timer=30; //The shot is over once the ball stopped rolling
+        if(bodies.rest_steps[body]<rest_needed)
+            island_rested[bodies.island[body]]=0;
+    }
+    for(int body=0;body<bodies.count;body++){
+        int flags=bodies.flags[body];
+        if((flags&BODY_ALIVE)==0 || (flags&BODY_FIXED) || (flags&BODY_SLEEPING))
+            continue;
+        if(island_rested[bodies.island[body]]==1){
+            bodies.flags[body]|=BODY_SLEEPING;
+            bodies.x_speed[body]=0;
+            bodies.y_speed[body]=0;
+        }
+    }
+}
+
+/* Body links */
+//The supporters and dependents of every body (See Support graph) and the sensors it is in are short lists of handles.
+//All the lists of a kind share one array, each body has its own slots in it, so the history saves and restores them
+//with a memcpy of arrays it allocated once. loadBodies gives every body room for the most bodies that fit side by
+//side along it. A list that still runs out of room is moved to the end of the array with twice the room. The worker
+//threads can't do that (the array would move under the other threads), linkAdd fails there and stepIslands makes
+//the room and steps the group again.
+void linksLayout(LinkLists &lists, const vector<int> &room){
+    lists.room=room;
+    lists.start.resize(room.size());
+    lists.count.assign(room.size(),0);
+    int end=0;
+    for(int body=0;body<room.size();body++){
+        lists.start[body]=end;
+        end+=room[body];
+    }
+    lists.slots.assign(end,-1);
+}
+
+int linkCount(const LinkLists &lists, int body){
+    return lists.count[body];
+}
+
+int link(const LinkLists &lists, int body, int i){
+    return lists.slots[lists.start[body]+i];
+}
+
+//Move the list of body to the end of the array, with twice the room
+void linkGrow(LinkLists &lists, int body){
+    int start=lists.slots.size(), room=max(2*lists.room[body],4);
+    lists.slots.resize(start+room,-1);
+    for(int i=0;i<lists.count[body];i++)
+        lists.slots[start+i]=lists.slots[lists.start[body]+i];
+    lists.start[body]=start;
+    lists.room[body]=room;
+}
+
+//Appends value to the list of body. Returns 0 if the list is full on a worker thread.
+int linkAdd(LinkLists &lists, int body, int value){
+    if(lists.count[body]==lists.room[body]){
+        if(step_group!=NULL){
+            step_group->full_links=&lists;
+            step_group->full_body=body;
+            return 0;
+        }
+        linkGrow(lists,body);
+    }
+    lists.slots[lists.start[body]+lists.count[body]]=value;
+    lists.count[body]++;
+    return 1;
+}
+
+//Removes value from the list of body, the last one takes its place
+void linkErase(LinkLists &lists, int body, int value){
+    int *list=&lists.slots[lists.start[body]];
+    for(int i=0;i<lists.count[body];i++){
+        if(list[i]==value){
+            lists.count[body]--;
+            list[i]=list[lists.count[body]];
+            return;
+        }
+    }
+}
+
+void copyInts(vector<int> &to, const vector<int> &from){
+    to.resize(from.size()); //Only allocates if a list was moved since to was saved
+    if(!from.empty())
+        memcpy(&to[0],&from[0],from.size()*sizeof(int));
+}
+
+void copyLinks(LinkLists &to, const LinkLists &from){
+    copyInts(to.start,from.start);
+    copyInts(to.room,from.room);
+    copyInts(to.count,from.count);
+    copyInts(to.slots,from.slots);
+}
+
+/* Support graph */
+//Remembers which bodies each body is resting on (its supporters) and which bodies rest on it (its dependents).
+//An edge is added when a body is pushed out of another one from above, and it is only checked again when one
+//of the two bodies moves, so "is this body supported" is just a look at its list of supporters.
+//A body that loses its last supporter starts falling (and wakes up if it was sleeping).
+#define SUPPORT_DISTANCE 2 //How far below a body a supporter may be
+
+//Does body rest on supporter (supporter is right below it). Turned boxes and circles are lowered by the support
+//distance and have to touch supporter the way exactContact adds a support, from above.
+int restsOn(int body, int supporter){
+    stepStats().ground_probes++;
+    if(needsExactTest(body,supporter)){
+        real normal[2], depth;
+        return overlapBodies(body,supporter,normal,depth,-SUPPORT_DISTANCE) && normal[1]>0 && abs(normal[0])<=normal[1];
+    }
+    return checkCollisionBottom(bodies.x[supporter],bodies.y[supporter],bodies.width[supporter],bodies.height[supporter],bodies.x[body],bodies.y[body]-SUPPORT_DISTANCE,bodies.width[body],bodies.height[body]);
+}
+
+void addSupport(int body, int supporter){
+    for(int i=0;i<linkCount(bodies.supported_by,body);i++)
+        if(link(bodies.supported_by,body,i)==supporter)
+            return;
+    linkAdd(bodies.supported_by,body,supporter);
+    if(step_group!=NULL && (bodies.flags[supporter]&BODY_FIXED)) //Fixed bodies are shared by all the groups
+        step_group->support_edits.push_back(SupportEdit{body,supporter,1});
+    else
+        linkAdd(bodies.supporting,supporter,body);
+}
+
+void removeSupport(int body, int supporter){
+    linkErase(bodies.supported_by,body,supporter);
+    if(step_group!=NULL && (bodies.flags[supporter]&BODY_FIXED))
+        step_group->support_edits.push_back(SupportEdit{body,supporter,0});
+    else
+        linkErase(bodies.supporting,supporter,body);
+    if(linkCount(bodies.supported_by,body)==0 && (bodies.flags[body]&BODY_FIXED)==0){
+        if(bodies.flags[body]&BODY_SLEEPING)
+            wakeIsland(bodies.island[body]);
+        bodies.flags[body]|=BODY_IN_AIR;
+    }
+}
+
+int isSupported(int body){
+    return linkCount(bodies.supported_by,body)>0;
+}
+
+//Call after a body moved, drops the edges that no longer hold (on both sides of the body)
+void supportMoved(int body){
+    for(int i=linkCount(bodies.supporting,body)-1;i>=0;i--)
+        if(i<linkCount(bodies.supporting,body) && !restsOn(link(bodies.supporting,body,i),body))
+            removeSupport(link(bodies.supporting,body,i),body);
+    for(int i=linkCount(bodies.supported_by,body)-1;i>=0;i--)
+        if(i<linkCount(bodies.supported_by,body) && !restsOn(body,link(bodies.supported_by,body,i)))
+            removeSupport(body,link(bodies.supported_by,body,i));
+}
+
+//Call when a body is destroyed, only the bodies resting on it are affected
+void removeSupports(int body){
+    while(linkCount(bodies.supporting,body)>0)
+        removeSupport(link(bodies.supporting,body,linkCount(bodies.supporting,body)-1),body);
+    while(linkCount(bodies.supported_by,body)>0)
+        removeSupport(body,link(bodies.supported_by,body,linkCount(bodies.supported_by,body)-1));
+}
+
+//Add the edges of a body that was placed on something by hand (like when loading the level)
+void findSupports(int body){
+    static vector<int> below;
+    gridQuery(bodies.x[body],bodies.y[body]-SUPPORT_DISTANCE,boundsWidth(body),boundsHeight(body),0,0,below);
+    for(int i=0;i<below.size();i++)
+        if(below[i]!=body && (bodies.flags[below[i]]&BODY_ALIVE) && restsOn(body,below[i]))
+            addSupport(body,below[i]);
+}
+
+pair<real,real> moveObject(int body, real dx, real dy) {
+    bodies.x[body]+=dx;
+    bodies.y[body]+=dy;
+    gridUpdate(body);
+    supportMoved(body);
+    return make_pair(bodies.x[body],bodies.y[body]);
+}
+
+//Place a body without it appearing to slide there (skips render interpolation)
+void teleportBody(int body, real x, real y) {
+    bodies.x[body]=x;
+    bodies.y[body]=y;
+    bodies.prev_x[body]=x;
+    bodies.prev_y[body]=y;
+    gridUpdate(body);
+    supportMoved(body);
+    if(bodies.flags[body]&BODY_SLEEPING)
+        wakeIsland(bodies.island[body]); //Anything resting on it has to fall
+    wakeBody(body);
+}
+
+int bodyHandle(string name) {
+    map<string,int>::iterator it = bodyNames.find(name);
+    if(it==bodyNames.end())
+        return -1;
+    return it->second;
+}
+
+/* Sensors */
+//Trigger volumes that bodies pass through without colliding, like the coins and the spring switch. They are kept
+//apart from the bodies in their own grid (same cells as the body grid), and only bodies flagged BODY_TRIGGERS are
+//tested against them, with the sensors of the cells they are in. So the cost doesn't depend on the number of sensors
+//in the level. A sensor calls enter when a body starts overlapping it and exit when it stops (or the sensor is
+//disabled). Sensors don't move once they are added.
+#define SENSOR_BUCKETS 256 //Must be a power of 2
+
+struct Sensor {
+    real x,y,width,height;
+    int enabled;
+    SensorCallback enter,exit;
+    int data;
+};
+typedef struct Sensor Sensor;
+
+vector<Sensor> sensors;
+vector<int> sensor_buckets[SENSOR_BUCKETS];
+LinkLists sensors_inside; //Sorted sensors each body overlaps, only bodies with BODY_TRIGGERS have room
+
+void clearSensors(){
+    sensors.clear();
+    for(int i=0;i<SENSOR_BUCKETS;i++)
+        sensor_buckets[i].clear();
+    vector<int> room(bodies.count,0);
+    for(int body=0;body<bodies.count;body++)
+        if(bodies.flags[body]&BODY_TRIGGERS)
+            room[body]=4;
+    linksLayout(sensors_inside,room);
+}
+
+int addSensor(float x, float y, float width, float height, SensorCallback enter, SensorCallback exit, int data){
+    Sensor sensor = {x,y,width,height,1,enter,exit,data};
+    int index=sensors.size();
+    sensors.push_back(sensor);
+    int x0=gridCell(sensor.x-sensor.width/2), x1=gridCell(sensor.x+sensor.width/2);
+    int y0=gridCell(sensor.y-sensor.height/2), y1=gridCell(sensor.y+sensor.height/2);
+    for(int cx=x0;cx<=x1;cx++)
+        for(int cy=y0;cy<=y1;cy++){
+            vector<int> &bucket = sensor_buckets[gridBucket(cx,cy)&(SENSOR_BUCKETS-1)];
+            if(bucket.empty() || bucket.back()!=index) //Cells sharing a bucket would add it twice
+                bucket.push_back(index);
+        }
+    return index;
+}
+
+void enableSensor(int sensor, int enabled){
+    sensors[sensor].enabled=enabled;
+}
+
+int sensorData(int sensor){
+    return sensors[sensor].data;
+}
+
+//Call after a body with BODY_TRIGGERS moved, calls the callbacks of the sensors it entered or left
+void sensorTest(int body){
+    static thread_local vector<int> found;
+    found.clear();
+    real x=bodies.x[body], y=bodies.y[body], width=bodies.width[body], height=bodies.height[body];
+    int x0=gridCell(x-width/2), x1=gridCell(x+width/2);
+    int y0=gridCell(y-height/2), y1=gridCell(y+height/2);
+    for(int cx=x0;cx<=x1;cx++)
+        for(int cy=y0;cy<=y1;cy++){
+            vector<int> &bucket = sensor_buckets[gridBucket(cx,cy)&(SENSOR_BUCKETS-1)];
+            for(int i=0;i<bucket.size();i++){
+                Sensor &sensor = sensors[bucket[i]];
+                if(sensor.enabled && abs(sensor.x-x)<(sensor.width+width)/2 && abs(sensor.y-y)<(sensor.height+height)/2)
+                    found.push_back(bucket[i]);
+            }
+        }
+    sort(found.begin(),found.end());
+    found.erase(unique(found.begin(),found.end()),found.end());
+
+    if(linkCount(sensors_inside,body)==0 && found.empty())
+        return;
+    static thread_local vector<int> before;
+    before.clear();
+    for(int i=0;i<linkCount(sensors_inside,body);i++)
+        before.push_back(link(sensors_inside,body,i));
+    sensors_inside.count[body]=0;
+    for(int i=0;i<found.size();i++)
+        linkAdd(sensors_inside,body,found[i]);
+    //Both lists are sorted, walk them together
+    int i=0, j=0;
+    while(i<before.size() || j<found.size()){
+        if(j==found.size() || (i<before.size() && before[i]<found[j])){
+            if(sensors[before[i]].exit!=NULL)
+                sensors[before[i]].exit(before[i],body);
+            i++;
+        }
+        else if(i==before.size() || found[j]<before[i]){
+            if(sensors[found[j]].enter!=NULL)
+                sensors[found[j]].enter(found[j],body);
+            j++;
+        }
+        else{
+            i++;
+            j++;
+        }
+    }
+}
+
+//Show the points just scored above whatever gave them, (x,top) is the middle of its top edge
+void showScorePopup(const char *text, float x, float top, float background_offset){
+    score_popup.timer=50;
+    for(int i=0;i<3;i++)
+        score_popup.text[i]=text[i];
+    score_popup.x=x;
+    score_popup.y=top+15;
+    score_popup.background_x=x+background_offset;
+}
+
+//Sensor of a coin or goal, data is its index in pickups
+void collectPickup(int sensor, int body){
+    Pickup &col_object=pickups[sensorData(sensor)];
+    col_object.alive=0;
+    enableSensor(sensor,0);
+    pushEvent(EVENT_PICKUP,body,sensorData(sensor),col_object.x,col_object.y+col_object.shape.height/2,col_object.points);
+}
+
+int spring_state=0; //0 up, 1 going down, 2 down (the goals are unlocked)
+int spring_press=0; //How far the spring still has to go down
+
+//Sensor covering springbase2, only landing on it from above presses it
+void pressSpring(int sensor, int body){
+    if(bodies.y[body]>sensors[sensor].y && spring_state==0){
+        spring_state=1;
+        spring_press=15;
+        enableSensor(sensor,0);
+        pushEvent(EVENT_SWITCH,body,body_springbase2,(float)sensors[sensor].x,(float)(sensors[sensor].y+sensors[sensor].height/2),0);
+    }
+}
+
+void addRectangleBody(string name, float weight, COLOR colorA, COLOR colorB, COLOR colorC, COLOR colorD, float x, float y, float height, float width, int fixed, float friction){
+    BodyDef def = {};
+    def.shape.name=name;
+    def.shape.type=SHAPE_RECTANGLE;
+    def.shape.color[0]=colorA;
+    def.shape.color[1]=colorB;
+    def.shape.color[2]=colorC;
+    def.shape.color[3]=colorD;
+    def.shape.width=width;
+    def.shape.height=height;
+    def.x=x;
+    def.y=y;
+    def.weight=weight;
+    def.friction=friction;
+    def.fixed=fixed;
+    level_bodies[name]=def;
+}
+
+void addCircleBody(string name, float weight, COLOR color, float x, float y, float r, int parts, int fixed, float friction){
+    BodyDef def = {};
+    def.shape.name=name;
+    def.shape.type=SHAPE_CIRCLE;
+    for(int i=0;i<4;i++)
+        def.shape.color[i]=color;
+    def.shape.width=2*r; //The box around the circle
+    def.shape.height=2*r;
+    def.shape.parts=parts;
+    def.x=x;
+    def.y=y;
+    def.weight=weight;
+    def.friction=friction;
+    def.fixed=fixed;
+    level_bodies[name]=def;
+}
+
+void addPickup(string name, int kind, COLOR color, float x, float y, float r, int parts){
+    Pickup coin = {};
+    coin.shape.name=name;
+    coin.shape.type=SHAPE_CIRCLE;
+    for(int i=0;i<4;i++)
+        coin.shape.color[i]=color;
+    coin.shape.width=2*r;
+    coin.shape.height=2*r;
+    coin.shape.parts=parts;
+    coin.kind=kind;
+    coin.x=x;
+    coin.y=y;
+    coin.alive = kind==PICKUP_COIN; //Goals appear when the switch is pressed
+    coin.points = kind==PICKUP_COIN ? 100 : 200;
+    pickups.push_back(coin);
+}
+
+//Move every body created with addRectangleBody/addCircleBody into the body store
+//Call once after all the bodies of the level have been created
+void loadBodies(){
+    bodies = BodyStore();
+    bodyNames.clear();
+    for(map<string,BodyDef>::iterator it=level_bodies.begin();it!=level_bodies.end();it++){
+        BodyDef &def = it->second;
+        int flags=BODY_ALIVE;
+        if(def.fixed==1)
+            flags|=BODY_FIXED;
+        if(it->first.compare(0,3,"pig")==0)
+            flags|=BODY_PIG;
+        bodyNames[it->first]=bodies.count;
+        bodies.x.push_back(def.x);
+        bodies.y.push_back(def.y);
+        bodies.prev_x.push_back(def.x);
+        bodies.prev_y.push_back(def.y);
+        bodies.x_speed.push_back(0);
+        bodies.y_speed.push_back(0);
+        bodies.width.push_back(def.shape.width);
+        bodies.height.push_back(def.shape.height);
+        bodies.radius.push_back(def.shape.type==SHAPE_CIRCLE ? real(def.shape.width/2) : length(def.shape.width,def.shape.height)/2);
+        bodies.bounds_width.push_back(def.shape.width);
+        bodies.bounds_height.push_back(def.shape.height);
+        bodies.exact.push_back(def.shape.type==SHAPE_CIRCLE);
+        bodies.weight.push_back(def.weight);
+        bodies.friction.push_back(def.friction);
+        bodies.flags.push_back(flags);
+        bodies.health.push_back(100);
+        bodies.rest_steps.push_back(0);
+        bodies.island.push_back(bodies.count);
+        bodies.angle.push_back(0);
+        bodies.rem_angle.push_back(0);
+        bodies.rotating.push_back(0);
+        bodies.direction.push_back(0);
+        bodies.shape.push_back(def.shape);
+        bodies.count++;
+    }
+    const char *boundaries[] = {"floor","floor2","roof","wall1","wall2"};
+    for(int i=0;i<5;i++)
+        if(bodyHandle(boundaries[i])!=-1)
+            bodies.flags[bodyHandle(boundaries[i])]|=BODY_BOUNDARY;
+    body_cannonball=bodyHandle("cannonball");
+    if(body_cannonball!=-1)
+        bodies.flags[body_cannonball]|=BODY_FAST|BODY_TRIGGERS;
+    body_springbase1=bodyHandle("springbase1");
+    body_springbase2=bodyHandle("springbase2");
+    body_springbase3=bodyHandle("springbase3");
+
+    //Room in the support lists for the narrowest body of the level side by side along the body, at any angle
+    float narrowest=0;
+    for(int body=0;body<bodies.count;body++)
+        if((bodies.flags[body]&BODY_FIXED)==0 && (narrowest==0 || min(bodies.shape[body].width,bodies.shape[body].height)<narrowest))
+            narrowest=min(bodies.shape[body].width,bodies.shape[body].height);
+    vector<int> room(bodies.count);
+    for(int body=0;body<bodies.count;body++)
+        room[body] = narrowest>0 ? (int)(2*(float)bodies.radius[body]/narrowest)+4 : 4;
+    linksLayout(bodies.supported_by,room);
+    linksLayout(bodies.supporting,room);
+    gridRebuild();
+    for(int body=0;body<bodies.count;body++)
+        if((bodies.flags[body]&BODY_FIXED)==0 && (bodies.flags[body]&BODY_ALIVE))
+            findSupports(body);
+
+    clearSensors();
+    for(int i=0;i<pickups.size();i++){
+        pickups[i].sensor=addSensor(pickups[i].x,pickups[i].y,pickups[i].shape.width,pickups[i].shape.height,collectPickup,NULL,i);
+        enableSensor(pickups[i].sensor,pickups[i].alive);
+    }
+    if(body_springbase2!=-1)
+        addSensor((float)bodies.x[body_springbase2],(float)bodies.y[body_springbase2],(float)bodies.width[body_springbase2],(float)bodies.height[body_springbase2],pressSpring,NULL,0);
+}
+
+/* Continuous collision for fast bodies */
+//A body flagged BODY_FAST is swept as a circle along each move before it is moved, and the move is cut short at
+//the first body the circle would touch. checkCollision then resolves that contact as usual, so a fast body can't
+//pass through a wall or crate thinner than the distance it moves in one step, without substepping everything else.
+#define SWEEP_SKIN 0.01f //How far a cut short move goes into the body it hits, so the box tests see the contact
+
+//Time of impact in (0,1] of a circle moving by (dx,dy) against a box, 2 if it doesn't hit it.
+//A circle that already touches the box at the start is left to checkCollision.
+real sweepCircleBox(real x, real y, real radius, real dx, real dy, real box_x, real box_y, real box_width, real box_height){
+    real start[2]={x-box_x,y-box_y}, move[2]={dx,dy};
+    real half[2]={box_width/2,box_height/2};
+    //Against the box grown by the radius first
+    real t_enter=-1, t_exit=2;
+    for(int axis=0;axis<2;axis++){
+        real extent=half[axis]+radius;
+        if(move[axis]==0){
+            if(abs(start[axis])>=extent)
+                return 2;
+            continue;
+        }
+        real t0=(-extent-start[axis])/move[axis], t1=(extent-start[axis])/move[axis];
+        if(t0>t1)
+            swap(t0,t1);
+        t_enter=max(t_enter,t0);
+        t_exit=min(t_exit,t1);
+    }
+    if(t_enter>=t_exit || t_enter<=0 || t_enter>1)
+        return 2;
+    //Entering the grown box next to a corner, the circle has to hit the rounded corner itself
+    real hit[2]={start[0]+dx*t_enter,start[1]+dy*t_enter};
+    if(abs(hit[0])<=half[0] || abs(hit[1])<=half[1])
+        return t_enter;
+    //Along the unit direction of the move, so nothing larger than the corner's neighbourhood gets squared
+    real move_length=length(dx,dy);
+    real direction[2]={dx/move_length,dy/move_length};
+    real to_corner[2]={start[0]-(hit[0]>0 ? half[0] : -half[0]),start[1]-(hit[1]>0 ? half[1] : -half[1])};
+    real along=direction[0]*to_corner[0]+direction[1]*to_corner[1];
+    real c=to_corner[0]*to_corner[0]+to_corner[1]*to_corner[1]-radius*radius;
+    real discriminant=along*along-c;
+    if(c<=0 || discriminant<0)
+        return 2;
+    real t=(-along-sqrt(discriminant))/move_length;
+    if(t<=0 || t>1)
+        return 2;
+    return t;
+}
+
+//The part of the move (dx,dy) that a fast body can make before it touches another body
+pair<real,real> sweepMove(int body, real dx, real dy){
+    static thread_local vector<int> candidates;
+    real radius=min(bodies.width[body],bodies.height[body])/2;
+    gridQuery(bodies.x[body]+dx/2,bodies.y[body]+dy/2,bodies.width[body],bodies.height[body],abs(dx)/2,abs(dy)/2,candidates);
+    real first_hit=2;
+    for(int c=0;c<candidates.size();c++){
+        int col=candidates[c];
+        if(col==body || (bodies.flags[col]&BODY_ALIVE)==0)
+            continue;
+        first_hit=min(first_hit,sweepCircleBox(bodies.x[body],bodies.y[body],radius,dx,dy,bodies.x[col],bodies.y[col],boundsWidth(col),boundsHeight(col)));
+    }
+    if(first_hit>1)
+        return make_pair(dx,dy);
+    real cut=min(first_hit+real(SWEEP_SKIN)/length(dx,dy),real(1));
+    return make_pair(dx*cut,dy*cut);
+}
+
+//Check collisions between rectangles only
+//Bounding boxes collision
+//Best Method
+int checkCollision(int body, real dx, real dy){
+    chrono::steady_clock::time_point lap = stepClock();
+    int any_collide=0;
+    if(bodies.flags[body]&BODY_TRIGGERS)
+        sensorTest(body);
+
+    //Only the bodies sharing a grid cell with the moved body (including the distance it just moved) can collide
+    static thread_local vector<int> candidates;
+    real width=boundsWidth(body), height=boundsHeight(body);
+    gridQuery(bodies.x[body],bodies.y[body],width,height,abs(dx),abs(dy),candidates);
+    int pairs_tested=candidates.size()-count(candidates.begin(),candidates.end(),body);
+
+    //Test all of them at once, then only resolve the ones that collide in the direction of the move
+    static thread_local PackedBoxes boxes;
+    static thread_local vector<unsigned> right,left,top,bottom,hits;
+    packBoxes(candidates,boxes);
+    PhysicsStats &stats = stepStats();
+    stats.broadphase_us+=lapMicroseconds(lap);
+    int words=(boxes.count+31)/32+1;
+    right.resize(words);
+    left.resize(words);
+    top.resize(words);
+    bottom.resize(words);
+    hits.resize(words);
+    real masks_x, masks_y; //Position of the moved body the masks were computed for
+    int masks_valid=0;
+    for(int c=0;c<candidates.size();c++){
+        if(!masks_valid || bodies.x[body]!=masks_x || bodies.y[body]!=masks_y){ //Pushing the body out of a collision moves it
+            masks_valid=1;
+            masks_x=bodies.x[body];
+            masks_y=bodies.y[body];
+            collisionMasks(masks_x,masks_y,width,height,boxes,&right[0],&left[0],&top[0],&bottom[0]);
+            for(int w=0;w<words;w++)
+                hits[w]=(dx>0 ? right[w] : 0) | (dx<0 ? left[w] : 0) | (dy>0 ? top[w] : 0) | (dy<=0 ? bottom[w] : 0);
+        }
+        c=nextSetBit(&hits[0],c,candidates.size());
+        if(c==candidates.size())
+            break;
+        int col=candidates[c];
+        int collide=0;
+        if((bodies.flags[col]&BODY_ALIVE)==0 || (bodies.flags[body]&BODY_FIXED))
+            continue;
+        if(col!=body && bodies.height[col]!=-1){ //Check collision only with circles and rectangles
+            int exact=needsExactTest(body,col), axis, sign;
+            real push;
+            if(exact ? exactContact(body,col,dx,dy,axis,sign,push) : (dx>0 && checkCollisionRight(col,body)) || (dx<0 && checkCollisionLeft(col,body)) || (dy>0 && checkCollisionTop(col,body)) || (dy<=0 && checkCollisionBottom(col,body))){
+                collide=1;
+                if(bodies.flags[col]&BODY_SLEEPING)
+                    wakeIsland(bodies.island[col]);
+                if((bodies.flags[col]&BODY_FIXED)==0){
+                    addContact(body,col);
+                    bodies.flags[col]|=BODY_IN_AIR;
+                    if(bodies.rotating[col]==0 && body==body_cannonball && (abs(bodies.x_speed[body])>=15 || abs(bodies.y_speed[body])>=15)){
+                        if(bodies.x_speed[body]>0 || bodies.y_speed[body]>0){
+                            bodies.rotating[col]=1;
+                            bodies.direction[col]=0;
+                            bodies.rem_angle[col]=90;
+                        }
+                        else{
+                            bodies.rotating[col]=1;
+                            bodies.direction[col]=1;
+                            bodies.rem_angle[col]=90;
+                        }
+                    }
+                }
+                //Push the moved body out the way it came, the speeds are left to the solver
+                if(exact){
+                    if(axis==0)
+                        bodies.x[body]+=sign*push;
+                    else
+                        bodies.y[body]+=sign*push;
+                    if(axis==1 && sign==1)
+                        addSupport(body,col);
+                    addSolverContact(body,col,axis,sign);
+                }
+                else{
+                    if(dx>0 && checkCollisionRight(col,body)){
+                        bodies.x[body]=bodies.x[col]-bodies.width[col]/2-bodies.width[body]/2;
+                        addSolverContact(body,col,0,-1);
+                    }
+                    else if(dx<0 && checkCollisionLeft(col,body)){
+                        bodies.x[body]=bodies.x[col]+bodies.width[col]/2+bodies.width[body]/2;
+                        addSolverContact(body,col,0,1);
+                    }
+                    if(dy>0 && checkCollisionTop(col,body)){
+                        bodies.y[body]=bodies.y[col]-bodies.height[col]/2-bodies.height[body]/2;
+                        addSolverContact(body,col,1,-1);
+                    }
+                    else if(dy<=0 && checkCollisionBottom(col,body)){
+                        bodies.y[body]=bodies.y[col]+bodies.height[col]/2+bodies.height[body]/2;
+                        addSupport(body,col);
+                        addSolverContact(body,col,1,1);
+                    }
+                }
+            }
+        }
+        if(collide==1 && body==body_cannonball && (bodies.flags[col]&BODY_FIXED)==0 && (abs(bodies.x_speed[body])>=5 || abs(bodies.y_speed[body])>=5)){
+            any_collide=1;
+            real damage=min(max(real(5),max(abs(bodies.x_speed[body]),abs(bodies.y_speed[body]))*real(2.5)),real(10));
+            int health=(int)(bodies.health[col]-damage);
+            float col_x=(float)bodies.x[col], col_top=(float)(bodies.y[col]+bodies.height[col]/2);
+            pushEvent(EVENT_HIT,body,col,col_x,col_top,bodies.health[col]-max(health,0));
+            bodies.health[col]=health;
+            if(bodies.health[col]<=0){
+                bodies.health[col]=0;
+                pushEvent(EVENT_DESTROYED,body,col,col_x,col_top,(bodies.flags[col]&BODY_PIG) ? 100 : 50);
+                bodies.flags[col]&=~BODY_ALIVE;
+                gridRemove(col);
+                removeSupports(col); //Whatever rested on it has to fall now
+                wakeIsland(bodies.island[col]);
+            }
+        }
+    }
+    gridUpdate(body);
+    stats.pairs_tested+=pairs_tested;
+    stats.pairs_culled+=bodies.count-1-pairs_tested;
+    stats.narrowphase_us+=lapMicroseconds(lap);
+    return any_collide;
+}
+
+
+/* Island stepping */
+//Every awake body claims the grid cells it could reach in this step (its box grown by twice its speed), and bodies
+//claiming the same cell, sleeping bodies stored in those cells and the islands of all of them (the contacts found by
+//checkCollision, see updateSleep) end up in one group. Groups share no cells, so they can be stepped at the same time
+//by physics_threads threads. The bodies of a group are stepped in handle order and what they record is merged in
+//handle order, so the result is the one of stepping all the bodies in handle order on one thread.
+//A body that would leave the cells of its group (it was hit harder than expected) takes the cells it needs if no
+//group claimed them and nothing outside the groups is stored there. Otherwise its group stops. A group only changes
+//its members, so stopping just undoes those members (saved when the group started). The cells the body needed are
+//then claimed, the groups owning them are undone too, and all of them are merged with whatever sleeps in those cells
+//into one group that is stepped again, until no group has to stop. The other groups keep what they stepped.
+//A step where one group holds nearly all the awake bodies (a single pile, like the stress levels) is stepped on the
+//calling thread, there is too little to run next to it, and so are the next few steps without building the groups.
+
+//Grid cell -> id of the group that claimed it. Open addressing, a slot is taken if it has the stamp of the table, so
+//clearing it is bumping the stamp and claiming cells allocates nothing once the table is big enough.
+struct CellClaim {
+    int cx,cy;
+    int group;
+    int stamp;
+};
+typedef struct CellClaim CellClaim;
+
+struct CellTable {
+    vector<CellClaim> slots; //A power of 2, at least twice used
+    int stamp;
+    int used;
+};
+typedef struct CellTable CellTable;
+
+#define ISLAND_SHARE 0.9f //Largest group over all the awake bodies from which a step is stepped on one thread
+#define ISLAND_SERIAL_STEPS 8 //Steps stepped on one thread after that before the groups are built again
+
+int physics_threads=1; //Threads stepping the physics, set with the first command line argument
+int island_serial_steps=0; //Left of ISLAND_SERIAL_STEPS
+vector<IslandGroup> step_groups;
+CellTable cell_owner = {vector<CellClaim>(),1,0};
+vector<int> group_parent; //Union find over the bodies, only valid while building the groups
+vector<int> in_group;
+vector<int> island_sleepers; //The sleeping bodies by island, in handle order within one
+vector<int> island_first; //Index in island_sleepers of the first body of every island (islands are handles), and the end
+
+vector<thread> island_workers;
+mutex island_mutex;
+condition_variable island_start, island_finish;
+int island_round=0; //Bumped every time the workers are handed a step, -1 tells them to quit
+int island_workers_busy=0;
+vector<int> island_queue; //Groups handed to the workers
+atomic<int> island_next_group(0); //Next one of island_queue
+real island_time_delta;
+CellTable cell_claims = {vector<CellClaim>(),1,0}; //Cells the workers took while stepping, see claimCell
+mutex claim_mutex;
+
+void cellsClear(CellTable &table){
+    table.stamp++;
+    table.used=0;
+}
+
+//Slot of a cell, where it is or where it would go
+int cellSlot(const CellTable &table, int cx, int cy){
+    int mask=table.slots.size()-1;
+    int slot=(int)(((unsigned)cx*73856093u ^ (unsigned)cy*19349663u) & mask);
+    while(table.slots[slot].stamp==table.stamp && (table.slots[slot].cx!=cx || table.slots[slot].cy!=cy))
+        slot=(slot+1)&mask;
+    return slot;
+}
+
+//Group that claimed a cell, -1 if none did
+int cellOwner(const CellTable &table, int cx, int cy){
+    if(table.slots.empty())
+        return -1;
+    const CellClaim &claim = table.slots[cellSlot(table,cx,cy)];
+    return claim.stamp==table.stamp ? claim.group : -1;
+}
+
+//Claim a cell for group if no group did before. Returns the group that has it.
+int cellClaim(CellTable &table, int cx, int cy, int group){
+    if(2*(table.used+1)>table.slots.size()){ //Grow, keeping the cells claimed so far
+        vector<CellClaim> old;
+        old.swap(table.slots);
+        CellClaim free = {0,0,-1,0};
+        table.slots.assign(max(2*(int)old.size(),1024),free);
+        int stamp=table.stamp;
+        table.stamp=1;
+        table.used=0;
+        for(int i=0;i<old.size();i++)
+            if(old[i].stamp==stamp)
+                cellClaim(table,old[i].cx,old[i].cy,old[i].group);
+    }
+    int slot=cellSlot(table,cx,cy);
+    if(table.slots[slot].stamp==table.stamp)
+        return table.slots[slot].group;
+    CellClaim claim = {cx,cy,group,table.stamp};
+    table.slots[slot]=claim;
+    table.used++;
+    return group;
+}
+
+//Group of a body, without shortening the paths (the workers only read group_parent)
+int groupRoot(int body){
+    while(group_parent[body]!=body)
+        body=group_parent[body];
+    return body;
+}
+
+//Take a cell no group claimed for the group stepped by this thread. Fails if another group took it first or if a
+//body that isn't in the group (a sleeping body outside all the groups) is stored there.
+int claimCell(int cx, int cy){
+    lock_guard<mutex> lock(claim_mutex);
+    int group=cellOwner(cell_claims,cx,cy);
+    if(group!=-1)
+        return group==step_group->id;
+    vector<int> &bucket = grid_buckets[gridBucket(cx,cy)];
+    for(int i=0;i<bucket.size();i++){
+        int body=bucket[i];
+        if(grid_x0[body]<=cx && cx<=grid_x1[body] && grid_y0[body]<=cy && cy<=grid_y1[body] && (bodies.flags[body]&BODY_FIXED)==0 && body_group[body]!=step_group->id)
+            return 0;
+    }
+    cellClaim(cell_claims,cx,cy,step_group->id);
+    return 1;
+}
+
+//Is the box (grown by margin and the support distance) inside the cells of the group stepped by this thread
+int ownsRegion(real x, real y, real width, real height, real margin_x, real margin_y){
+    if(step_group==NULL)
+        return 1;
+    margin_x+=SUPPORT_DISTANCE;
+    margin_y+=SUPPORT_DISTANCE;
+    int x0=gridCell(x-width/2-margin_x), x1=gridCell(x+width/2+margin_x);
+    int y0=gridCell(y-height/2-margin_y), y1=gridCell(y+height/2+margin_y);
+    for(int cx=x0;cx<=x1;cx++){
+        for(int cy=y0;cy<=y1;cy++){
+            int owner=cellOwner(cell_owner,cx,cy);
+            if(owner!=-1 ? groupRoot(owner)==step_group->id : claimCell(cx,cy))
+                continue;
+            step_group->stop_x0=x0;
+            step_group->stop_y0=y0;
+            step_group->stop_x1=x1;
+            step_group->stop_y1=y1;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+//Advance one body by a step of time_delta. Returns 1, or 0 if it had to stop halfway because the body would leave
+//the cells of the group stepped on this thread.
+int stepBody(int body, real time_delta){
+    if(bodies.flags[body]&BODY_SLEEPING)
+        return 1;
+    if((bodies.flags[body]&BODY_BOUNDARY)==0){
+        if((bodies.y[body]>play_top || bodies.y[body]<play_bottom) && !ownsRegion(bodies.x[body],max(play_bottom,min(bodies.y[body],play_top)),bodies.width[body],bodies.height[body],0,0))
+            return 0;
+        if(bodies.y[body]>play_top){
+            bodies.y[body]=play_top;
+            bodies.y_speed[body]*=-1/2;
+            gridUpdate(body);
+            supportMoved(body);
+        }
+        if(bodies.y[body]<play_bottom){
+            bodies.y[body]=play_bottom;
+            bodies.y_speed[body]*=-1;
+            gridUpdate(body);
+            supportMoved(body);
+        }
+    }
+    if((bodies.flags[body]&BODY_ALIVE)==0)
+        return 1;
+    if((bodies.flags[body]&BODY_FIXED)==0 && bodies.y_speed[body]==0 && !isSupported(body)){
+        bodies.flags[body]|=BODY_IN_AIR;
+    }
+    for(int i=0;i<linkCount(bodies.supported_by,body);i++) //Resting on another body links the islands
+        if((bodies.flags[link(bodies.supported_by,body,i)]&BODY_FIXED)==0)
+            addContact(body,link(bodies.supported_by,body,i));
+    if((bodies.flags[body]&BODY_IN_AIR) && (bodies.flags[body]&BODY_FIXED)==0){
+        if(bodies.y_speed[body]>=-30)
+            bodies.y_speed[body]-=gravity*time_delta;
+        bodies.x_speed[body]-=airResistance*time_delta*bodies.x_speed[body];
+    }
+    int in_air=(bodies.flags[body]&BODY_IN_AIR) && (bodies.flags[body]&BODY_FIXED)==0;
+    if(in_air){
+        pair<real,real> move_x = make_pair(bodies.x_speed[body]*time_delta,real(0));
+        if(!ownsRegion(bodies.x[body],bodies.y[body],boundsWidth(body),boundsHeight(body),2*abs(move_x.first),0))
+            return 0;
+        stepStats().bodies_integrated++;
+        if(bodies.flags[body]&BODY_FAST)
+            move_x = sweepMove(body,move_x.first,0);
+        moveObject(body,move_x.first,0);
+        checkCollision(body,move_x.first,0); //Always call the checkCollision function with only 1 position change at a time!
+    }
+    if(in_air){
+        pair<real,real> move_y = make_pair(real(0),bodies.y_speed[body]*time_delta);
+        if(!ownsRegion(bodies.x[body],bodies.y[body],boundsWidth(body),boundsHeight(body),0,2*abs(move_y.second)))
+            return 0;
+        if(bodies.flags[body]&BODY_FAST)
+            move_y = sweepMove(body,0,move_y.second);
+        moveObject(body,0,move_y.second);
+        checkCollision(body,0,move_y.second);
+    }
+
+    if (bodies.rotating[body]==1 && body!=body_cannonball){
+        if(!ownsRegion(bodies.x[body],bodies.y[body],2*bodies.radius[body],2*bodies.radius[body],time_delta,0))
+            return 0;
+        bodies.rem_angle[body]-=9*time_delta;
+        real xShift = -0.5*time_delta;
+        if(bodies.direction[body]==0){
+            xShift*=-1;
+            bodies.angle[body]-=9*time_delta;
+        }
+        else
+            bodies.angle[body]+=9*time_delta;
+        updateBounds(body);
+        moveObject(body,xShift,0);
+        if(checkCollision(body,xShift,0)){
+            moveObject(body,-xShift,0);
+        }
+        if(bodies.rem_angle[body]<=0){
+            bodies.rotating[body]=0;
+        }
+    }
+    return 1;
+}
+
+int groupFind(int body){
+    while(group_parent[body]!=body){
+        group_parent[body]=group_parent[group_parent[body]];
+        body=group_parent[body];
+    }
+    return body;
+}
+
+void groupUnion(int a, int b){
+    a=groupFind(a);
+    b=groupFind(b);
+    if(a<b)
+        group_parent[b]=a;
+    else if(b<a)
+        group_parent[a]=b;
+}
+
+//Claim a cell for the group of owner. Joins the group that claimed it first, or pulls in the bodies stored there.
+void ownCell(int cx, int cy, int owner, vector<int> &queue){
+    int claimed=cellClaim(cell_owner,cx,cy,owner);
+    if(claimed!=owner){
+        groupUnion(claimed,owner);
+        return;
+    }
+    vector<int> &bucket = grid_buckets[gridBucket(cx,cy)];
+    for(int i=0;i<bucket.size();i++){
+        int other=bucket[i];
+        if(grid_x0[other]>cx || cx>grid_x1[other] || grid_y0[other]>cy || cy>grid_y1[other])
+            continue;
+        if(in_group[other] || (bodies.flags[other]&BODY_FIXED) || (bodies.flags[other]&BODY_ALIVE)==0)
+            continue;
+        in_group[other]=1;
+        groupUnion(owner,other);
+        queue.push_back(other);
+    }
+}
+
+//Claim the cells around a body for its group and pull in the bodies stored there and its island
+void claimCells(int body, real margin, vector<int> &queue){
+    margin+=SUPPORT_DISTANCE;
+    //A toppling body turns during the step, its bounding circle holds it at every angle
+    real width = bodies.rotating[body] ? 2*bodies.radius[body] : boundsWidth(body);
+    real height = bodies.rotating[body] ? 2*bodies.radius[body] : boundsHeight(body);
+    int x0=gridCell(bodies.x[body]-width/2-margin), x1=gridCell(bodies.x[body]+width/2+margin);
+    int y0=gridCell(bodies.y[body]-height/2-margin), y1=gridCell(bodies.y[body]+height/2+margin);
+    for(int cx=x0;cx<=x1;cx++)
+        for(int cy=y0;cy<=y1;cy++)
+            ownCell(cx,cy,body,queue);
+    for(int i=island_first[bodies.island[body]];i<island_first[bodies.island[body]+1];i++){
+        int other=island_sleepers[i];
+        if(in_group[other] || (bodies.flags[other]&BODY_FIXED) || (bodies.flags[other]&BODY_ALIVE)==0)
+            continue;
+        in_group[other]=1;
+        groupUnion(body,other);
+        queue.push_back(other);
+    }
+}
+
+//Split the awake bodies into groups that can be stepped independently
+void buildGroups(real time_delta){
+    group_parent.resize(bodies.count);
+    in_group.assign(bodies.count,0);
+    cellsClear(cell_owner);
+    island_first.assign(bodies.count+1,0);
+    for(int body=0;body<bodies.count;body++){
+        group_parent[body]=body;
+        if(bodies.flags[body]&BODY_SLEEPING)
+            island_first[bodies.island[body]+1]++;
+    }
+    for(int island=0;island<bodies.count;island++)
+        island_first[island+1]+=island_first[island];
+    static vector<int> next_sleeper;
+    next_sleeper.assign(island_first.begin(),island_first.end()-1);
+    island_sleepers.resize(island_first[bodies.count]);
+    for(int body=0;body<bodies.count;body++)
+        if(bodies.flags[body]&BODY_SLEEPING)
+            island_sleepers[next_sleeper[bodies.island[body]]++]=body;
+
+    static vector<int> queue;
+    queue.clear();
+    for(int body=0;body<bodies.count;body++){
+        int flags=bodies.flags[body];
+        if((flags&BODY_SLEEPING) || (flags&BODY_FIXED) || (flags&BODY_ALIVE)==0)
+            continue;
+        in_group[body]=1;
+        real reach=(abs(bodies.x_speed[body])+abs(bodies.y_speed[body])+gravity*time_delta+1)*time_delta;
+        claimCells(body,2*reach,queue);
+    }
+    for(int i=0;i<queue.size();i++) //Sleeping bodies only claim their own cells
+        claimCells(queue[i],0,queue);
+
+    step_groups.clear();
+    static vector<int> group_index;
+    group_index.assign(bodies.count,-1);
+    body_group.assign(bodies.count,-1);
+    for(int body=0;body<bodies.count;body++){
+        if(in_group[body]==0)
+            continue;
+        int root=groupFind(body);
+        if(group_index[root]==-1){ //Walking the handles in order, the root is the lowest handle of its group
+            group_index[root]=step_groups.size();
+            step_groups.push_back(IslandGroup());
+            step_groups.back().id=root;
+        }
+        step_groups[group_index[root]].members.push_back(body);
+        body_group[body]=root;
+    }
+    for(int i=0;i<cell_owner.slots.size();i++)
+        if(cell_owner.slots[i].stamp==cell_owner.stamp)
+            cell_owner.slots[i].group=groupFind(cell_owner.slots[i].group);
+}
+
+//Remember the members of a group as they are before it is stepped
+void saveGroup(IslandGroup &group){
+    LinkLists *lists[3] = {&bodies.supported_by,&bodies.supporting,&sensors_inside};
+    int triggers=0;
+    group.saved.resize(group.members.size());
+    group.saved_links.clear();
+    group.saved_sensors.clear();
+    for(int i=0;i<group.members.size();i++){
+        int body=group.members[i];
+        SavedBody saved = {bodies.x[body],bodies.y[body],bodies.x_speed[body],bodies.y_speed[body],
+            bodies.angle[body],bodies.rem_angle[body],bodies.bounds_width[body],bodies.bounds_height[body],
+            bodies.flags[body],bodies.health[body],bodies.rest_steps[body],bodies.exact[body],bodies.rotating[body],bodies.direction[body]};
+        group.saved[i]=saved;
+        for(int l=0;l<3;l++){
+            group.saved_links.push_back(linkCount(*lists[l],body));
+            for(int j=0;j<linkCount(*lists[l],body);j++)
+                group.saved_links.push_back(link(*lists[l],body,j));
+        }
+        triggers|=bodies.flags[body]&BODY_TRIGGERS;
+    }
+    //Only bodies with BODY_TRIGGERS change the sensors, the pickups and the spring switch. The cannonball is the only
+    //one, so no other group changes them at the same time.
+    if(triggers){
+        for(int i=0;i<sensors.size();i++)
+            group.saved_sensors.push_back(sensors[i].enabled);
+        for(int i=0;i<pickups.size();i++)
+            group.saved_sensors.push_back(pickups[i].alive);
+        group.saved_sensors.push_back(spring_state);
+        group.saved_sensors.push_back(spring_press);
+    }
+}
+
+//Put the members of a group back the way they were before it was stepped and forget what it recorded
+void undoGroup(IslandGroup &group){
+    LinkLists *lists[3] = {&bodies.supported_by,&bodies.supporting,&sensors_inside};
+    int next=0;
+    for(int i=0;i<group.members.size();i++){
+        int body=group.members[i];
+        const SavedBody &saved = group.saved[i];
+        bodies.x[body]=saved.x;
+        bodies.y[body]=saved.y;
+        bodies.x_speed[body]=saved.x_speed;
+        bodies.y_speed[body]=saved.y_speed;
+        bodies.angle[body]=saved.angle;
+        bodies.rem_angle[body]=saved.rem_angle;
+        bodies.bounds_width[body]=saved.bounds_width;
+        bodies.bounds_height[body]=saved.bounds_height;
+        bodies.flags[body]=saved.flags;
+        bodies.health[body]=saved.health;
+        bodies.rest_steps[body]=saved.rest_steps;
+        bodies.exact[body]=saved.exact;
+        bodies.rotating[body]=saved.rotating;
+        bodies.direction[body]=saved.direction;
+        for(int l=0;l<3;l++){ //The lists only grow, the saved ones still fit
+            LinkLists &list = *lists[l];
+            list.count[body]=group.saved_links[next++];
+            for(int j=0;j<list.count[body];j++)
+                list.slots[list.start[body]+j]=group.saved_links[next++];
+        }
+    }
+    if(!group.saved_sensors.empty()){
+        next=0;
+        for(int i=0;i<sensors.size();i++)
+            sensors[i].enabled=group.saved_sensors[next++];
+        for(int i=0;i<pickups.size();i++)
+            pickups[i].alive=group.saved_sensors[next++];
+        spring_state=group.saved_sensors[next++];
+        spring_press=group.saved_sensors[next++];
+    }
+    gridDiscard(group);
+    group.contacts.clear();
+    group.support_edits.clear();
+    group.events.clear();
+    group.solver_contacts.clear();
+    group.marks.clear();
+    //Only the time it took is kept, the counters are those of stepping it again
+    physics_stats.integration_us+=group.stats.integration_us;
+    physics_stats.broadphase_us+=group.stats.broadphase_us;
+    physics_stats.narrowphase_us+=group.stats.narrowphase_us;
+    group.stats=PhysicsStats();
+}
+
+void stepGroup(IslandGroup &group, real time_delta){
+    step_group=&group;
+    group.stats=PhysicsStats();
+    group.stopped=0;
+    group.stop_x0=0;
+    group.stop_x1=-1;
+    group.full_links=NULL;
+    int heads=64; //About one per member, like the grid
+    while(heads<group.members.size())
+        heads*=2;
+    group.grid_heads.assign(heads,-1);
+    chrono::steady_clock::time_point lap = stepClock();
+    saveGroup(group);
+    for(int i=0;i<group.members.size();i++){
+        StepMark mark = {group.members[i],(int)group.contacts.size(),(int)group.support_edits.size(),(int)group.events.size()};
+        group.marks.push_back(mark);
+        if(!stepBody(group.members[i],time_delta) || group.full_links!=NULL){ //See stepIslands
+            group.stopped=1;
+            break;
+        }
+    }
+    group.stats.integration_us+=lapMicroseconds(lap);
+    step_group=NULL;
+}
+
+//Run by the workers and the main thread, takes groups until there are none left
+void stepGroups(){
+    while(1){
+        int g=island_next_group++;
+        if(g>=island_queue.size())
+            return;
+        stepGroup(step_groups[island_queue[g]],island_time_delta);
+    }
+}
+
+void islandWorker(){
+    int round=0;
+    while(1){
+        {
+            unique_lock<mutex> lock(island_mutex);
+            while(island_round==round)
+                island_start.wait(lock);
+            if(island_round==-1)
+                return;
+            round=island_round;
+        }
+        stepGroups();
+        {
+            lock_guard<mutex> lock(island_mutex);
+            island_workers_busy--;
+        }
+        island_finish.notify_one();
+    }
+}
+
+void stopIslandWorkers(){
+    {
+        lock_guard<mutex> lock(island_mutex);
+        island_round=-1;
+    }
+    island_start.notify_all();
+    for(int i=0;i<island_workers.size();i++)
+        island_workers[i].join();
+    island_workers.clear();
+}
+
+void startIslandWorkers(){
+    for(int i=1;i<physics_threads;i++)
+        island_workers.push_back(thread(islandWorker));
+    atexit(stopIslandWorkers); //Before the globals above are destroyed
+}
+
+//Step the groups of island_queue on all the threads
+void stepRound(){
+    island_next_group=0;
+    if(island_queue.size()==1){ //Not worth waking the workers
+        stepGroups();
+        return;
+    }
+    {
+        lock_guard<mutex> lock(island_mutex);
+        island_workers_busy=physics_threads-1;
+        island_round=(island_round+1)&0x3fffffff;
+    }
+    island_start.notify_all();
+    stepGroups();
+    {
+        unique_lock<mutex> lock(island_mutex);
+        while(island_workers_busy>0)
+            island_finish.wait(lock);
+    }
+}
+
+//Claim the cells a member of a stopped group needed, joining the groups that own them and pulling in the bodies
+//outside the groups that are stored there
+void claimStop(IslandGroup &group, vector<int> &pulled){
+    for(int cx=group.stop_x0;cx<=group.stop_x1;cx++)
+        for(int cy=group.stop_y0;cy<=group.stop_y1;cy++)
+            ownCell(cx,cy,group.id,pulled);
+}
+
+//After a round, undo every group that had to stop together with the groups and sleeping bodies in the cells it
+//needed, and merge them into new groups. The new groups are left in island_queue for the next round.
+void mergeStopped(){
+    for(int i=0;i<cell_claims.slots.size() && cell_claims.used>0;i++) //The cells the workers took now belong to their groups
+        if(cell_claims.slots[i].stamp==cell_claims.stamp)
+            cellClaim(cell_owner,cell_claims.slots[i].cx,cell_claims.slots[i].cy,cell_claims.slots[i].group);
+    cellsClear(cell_claims);
+    static vector<int> pulled;
+    pulled.clear();
+    int stopped=0;
+    for(int q=0;q<island_queue.size();q++){
+        IslandGroup &group = step_groups[island_queue[q]];
+        if(group.stopped){
+            stopped=1;
+            claimStop(group,pulled);
+        }
+    }
+    island_queue.clear();
+    if(!stopped)
+        return;
+    for(int i=0;i<pulled.size();i++) //Sleeping bodies bring their islands and their cells
+        claimCells(pulled[i],0,pulled);
+
+    //-1 for a group that didn't change, -2 for one that has to be stepped again, then the index of its new group
+    static vector<int> merged;
+    merged.assign(bodies.count,-1);
+    int groups=step_groups.size();
+    for(int g=0;g<groups;g++){
+        IslandGroup &group = step_groups[g];
+        if(!group.members.empty() && (group.stopped || groupFind(group.id)!=group.id))
+            merged[groupFind(group.id)]=-2;
+    }
+    for(int g=0;g<groups;g++){
+        if(step_groups[g].members.empty() || merged[groupFind(step_groups[g].id)]==-1)
+            continue;
+        int root=groupFind(step_groups[g].id);
+        undoGroup(step_groups[g]);
+        if(step_groups[g].full_links!=NULL)
+            linkGrow(*step_groups[g].full_links,step_groups[g].full_body);
+        if(merged[root]==-2){
+            merged[root]=step_groups.size();
+            island_queue.push_back(step_groups.size());
+            step_groups.push_back(IslandGroup());
+            step_groups.back().id=root;
+        }
+        IslandGroup &from = step_groups[g], &to = step_groups[merged[root]];
+        to.members.insert(to.members.end(),from.members.begin(),from.members.end());
+        from.members.clear();
+    }
+    for(int i=0;i<pulled.size();i++)
+        step_groups[merged[groupFind(pulled[i])]].members.push_back(pulled[i]);
+    for(int q=0;q<island_queue.size();q++){
+        IslandGroup &group = step_groups[island_queue[q]];
+        sort(group.members.begin(),group.members.end());
+        for(int i=0;i<group.members.size();i++)
+            body_group[group.members[i]]=group.id;
+    }
+}
+
+//Step all the awake bodies, physics_threads at a time
+void stepIslands(real time_delta){
+    if(island_serial_steps>0){
+        island_serial_steps--;
+        for(int body=0;body<bodies.count;body++)
+            stepBody(body,time_delta);
+        return;
+    }
+    //Fixed and destroyed bodies don't move (apart from being kept inside the level) and join no group
+    for(int body=0;body<bodies.count;body++)
+        if((bodies.flags[body]&BODY_SLEEPING)==0 && ((bodies.flags[body]&BODY_FIXED) || (bodies.flags[body]&BODY_ALIVE)==0))
+            stepBody(body,time_delta);
+    buildGroups(time_delta);
+    int awake=0, largest=0;
+    for(int g=0;g<step_groups.size();g++){
+        awake+=step_groups[g].members.size();
+        largest=max(largest,(int)step_groups[g].members.size());
+    }
+    if(largest>=ISLAND_SHARE*awake){ //Step the rest like one thread would
+        island_serial_steps=ISLAND_SERIAL_STEPS;
+        for(int body=0;body<bodies.count;body++)
+            if((bodies.flags[body]&BODY_FIXED)==0 && (bodies.flags[body]&BODY_ALIVE))
+                stepBody(body,time_delta);
+        return;
+    }
+
+    chrono::steady_clock::time_point lap = stepClock();
+    island_time_delta=time_delta;
+    island_queue.clear();
+    for(int g=0;g<step_groups.size();g++)
+        island_queue.push_back(g);
+    while(!island_queue.empty()){
+        stepRound();
+        mergeStopped();
+    }
+    physics_stats.integration_us-=lapMicroseconds(lap); //The groups timed themselves on their threads
+
+    //Merge in the order the bodies would have been stepped in on one thread, the undone groups have no marks left
+    static vector< pair<int,int> > order; //(body,group) of every mark
+    static vector<int> next_mark; //Of every group
+    order.clear();
+    next_mark.assign(step_groups.size(),0);
+    for(int g=0;g<step_groups.size();g++){
+        IslandGroup &group = step_groups[g];
+        for(int i=0;i<group.marks.size();i++)
+            order.push_back(make_pair(group.marks[i].body,g));
+        StepMark end = {-1,(int)group.contacts.size(),(int)group.support_edits.size(),(int)group.events.size()};
+        group.marks.push_back(end);
+        solver_contacts.insert(solver_contacts.end(),group.solver_contacts.begin(),group.solver_contacts.end()); //Sorted by solveContacts
+        addStats(physics_stats,group.stats);
+    }
+    sort(order.begin(),order.end());
+    for(int i=0;i<order.size();i++){
+        IslandGroup &group = step_groups[order[i].second];
+        int next=next_mark[order[i].second]++;
+        const StepMark &from = group.marks[next], &to = group.marks[next+1];
+        if(grid_pending[order[i].first]!=-1)
+            gridApply(group.grid_changes[grid_pending[order[i].first]]);
+        step_contacts.insert(step_contacts.end(),group.contacts.begin()+from.contacts,group.contacts.begin()+to.contacts);
+        step_events.insert(step_events.end(),group.events.begin()+from.events,group.events.begin()+to.events);
+        for(int e=from.support_edits;e<to.support_edits;e++){
+            SupportEdit &edit = group.support_edits[e];
+            if(edit.added)
+                linkAdd(bodies.supporting,edit.supporter,edit.body);
+            else
+                linkErase(bodies.supporting,edit.supporter,edit.body);
+        }
+    }
+}
+
+/* Fixed timestep physics */
+//The physics always advances in steps of exactly 1/physics_hz seconds, no matter how fast the screen is drawn.
+//The caller decides how many steps to run (the game runs as many as fit in the elapsed time and interpolates the
+//bodies between the last two steps when drawing). Speeds are in units per 1/60th of a second, which is what all the
+//constants were tuned for.
+int physics_hz=120;
+real game_tick_accumulator=0; //Time since the last game tick in 1/60th of a second
+long long step_count=0; //Steps since the level was loaded
+long long shot_step=-1; //Value of step_count when the last shot was fired
+
+#define CANNON_X -315 //The barrel turns around this point
+#define CANNON_Y -210
+#define CANNON_LENGTH 80
+
+int cannon_recoil=0; //0 at rest, 1 going back after a shot, 2 coming back
+int cannon_recoil_dx=0; //How far it still has to go in this direction
+
+//Animations and timers that count in frames of the original 60Hz game
+void gameTick(){
+    if(score_popup.timer>0){
+        score_popup.timer--;
+        if(score_popup.timer<=0)
+            score_popup.timer=-1;
+    }
+
+    if(player_reset_timer>0){
+        player_reset_timer-=1;
+        if(player_reset_timer==0 && bodies.rest_steps[body_cannonball]>0 && player_status==1){
+            player_status=0;
+            teleportBody(body_cannonball,-315,-240);
+            bodies.flags[body_cannonball]&=~BODY_IN_AIR;
+        }
+    }
+
+    //Spring switch that unlocks the goals, springbase3 is squashed from the top
+    if(spring_state==1 && spring_press>0){
+        spring_press--;
+        for(int i=0;i<2;i++){
+            int body = i==0 ? body_springbase2 : body_springbase3;
+            real y=bodies.y[body];
+            if(body==body_springbase3){
+                bodies.height[body]-=1;
+                y+=1/2.0;
+            }
+            bodies.y[body]=y-1;
+            gridUpdate(body);
+            supportMoved(body);
+        }
+        if(spring_press==0){
+            spring_state=2;
+            for(int i=0;i<pickups.size();i++)
+                if(pickups[i].kind==PICKUP_GOAL){
+                    pickups[i].alive=1;
+                    enableSensor(pickups[i].sensor,1);
+                }
+        }
+    }
+
+    //Cannon recoil
+    if(cannon_recoil==1){
+        cannon_recoil_dx-=4;
+        if(cannon_recoil_dx==0){
+            cannon_recoil=2;
+            cannon_recoil_dx=16;
+        }
+    }
+    if(cannon_recoil==2){
+        cannon_recoil_dx-=1;
+        if(cannon_recoil_dx==0){
+            cannon_recoil=0;
+        }
+    }
+}
+
+//The gameplay side of the events of this step
+void applyEvents(){
+    for(int i=0;i<step_events.size();i++){
+        CollisionEvent &event = step_events[i];
+        if(event.type==EVENT_DESTROYED){
+            physics_stats.destroyed++;
+            player_score+=event.value;
+            if(bodies.flags[event.other]&BODY_PIG)
+                showScorePopup("100",event.x,event.y,5);
+            else
+                showScorePopup(".50",event.x,event.y,10);
+        }
+        else if(event.type==EVENT_PICKUP){
+            player_score+=event.value;
+            if(pickups[event.other].kind==PICKUP_COIN){
+                cout <<" COIN " << endl;
+                showScorePopup("100",event.x,event.y,5);
+            }
+            else{
+                cout <<" GOAL OBTAINED" << endl;
+                showScorePopup("200",event.x,event.y,0);
+            }
+        }
+    }
+}
+
+void saveHistory(); //See History
+
+void stepPhysics(){
+    real time_delta = real(60)/physics_hz;
+
+    chrono::steady_clock::time_point start = stepClock(), lap = start;
+    physics_stats=PhysicsStats();
+    step_contacts.clear();
+    step_events.clear();
+    bodies.prev_x=bodies.x;
+    bodies.prev_y=bodies.y;
+    //Physics of the bodies, walks the body store in handle order
+    if(physics_threads<=1){
+        for(int body=0;body<bodies.count;body++)
+            stepBody(body,time_delta);
+    }
+    else
+        stepIslands(time_delta);
+    //What the collision tests didn't take of the stepping was spent moving the bodies
+    physics_stats.integration_us+=lapMicroseconds(lap);
+    physics_stats.integration_us-=physics_stats.broadphase_us+physics_stats.narrowphase_us;
+    solveContacts();
+    physics_stats.response_us=lapMicroseconds(lap);
+    physics_stats.contacts_resolved=contact_cache.size(); //Where solveContacts keeps them for the next step
+    updateSleep();
+    applyEvents();
+
+    game_tick_accumulator+=time_delta;
+    while(game_tick_accumulator>=1){
+        game_tick_accumulator-=1;
+        gameTick();
+    }
+    step_count++;
+    saveHistory();
+    physics_stats.step_us=lapMicroseconds(start);
+}
+
+int launchCannonball(double x, double y, double x_speed, double y_speed){
+    if(player_status!=0)
+        return 0;
+    player_status=1;
+    if(bodies.flags[body_cannonball]&BODY_IN_AIR)
+        return 0;
+    bodies.flags[body_cannonball] |= BODY_IN_AIR;
+    teleportBody(body_cannonball, x, y);
+    //Set max jump speeds here (currently 30 and 30) (Adjust these as required)
+    bodies.y_speed[body_cannonball] = min(y_speed,30.0);
+    bodies.x_speed[body_cannonball] = min(x_speed,30.0);
+    shot_step=step_count;
+    cannon_recoil=1;
+    cannon_recoil_dx=16;
+    return 1;
+}
+
+//Speed of the ball for a launch power
+real launchSpeed(double power){
+#ifdef FIXED_POINT_PHYSICS
+    return fixedRaw(llround(abs(power))*10*FIXED_ONE/89120); //Whole steps of power, the speed would overflow otherwise
+#else
+    return abs(power*10/89120);
+#endif
+}
+
+void cannonLaunch(double angle, double power, double launch[4]){
+    real turn=angle, speed=launchSpeed(power);
+    launch[0]=(double)(CANNON_X+cosDegrees(turn)*CANNON_LENGTH);
+    launch[1]=(double)(CANNON_Y+sinDegrees(turn)*CANNON_LENGTH);
+    launch[2]=(double)(speed*cosDegrees(turn));
+    launch[3]=(double)(speed*sinDegrees(turn));
+}
+
+int fireCannon(double angle, double power){
+    double launch[4];
+    cannonLaunch(angle,power,launch);
+    return launchCannonball(launch[0],launch[1],launch[2],launch[3]);
+}
+
+//Put the cannonball back into the cannon, ready for the next shot
+void resetCannonball(){
+    teleportBody(body_cannonball,-315,-240);
+    bodies.flags[body_cannonball]&=~BODY_IN_AIR;
+    cannon_recoil=0;
+    cannon_recoil_dx=0;
+    player_status=0;
+}
+
+/* Trajectory preview */
+//Flies a copy of the cannonball alone through the current world, with the gravity, air resistance, steps and
+//play area limits of stepBody, swept against the bodies like a fast body. Where it hits something the real ball
+//would start pushing bodies around, so the preview ends at the first body it touches (or after TRAJECTORY_MAX_STEPS).
+//The flight continues from where it stopped on the next call, until the launch changes.
+#define TRAJECTORY_MAX_STEPS 1200
+#define TRAJECTORY_DOT_STEPS 6 //Steps between two dots
+
+TrajectoryPreview trajectory;
+double trajectory_launch[4]; //The launch the preview is for
+real trajectory_x, trajectory_y, trajectory_x_speed, trajectory_y_speed;
+int trajectory_steps=0;
+
+//One step of the preview ball, 1 if it hit a body
+int trajectoryStep(real time_delta){
+    static vector<int> candidates;
+    if(trajectory_y>play_top){
+        trajectory_y=play_top;
+        trajectory_y_speed*=-1/2;
+    }
+    if(trajectory_y<play_bottom){
+        trajectory_y=play_bottom;
+        trajectory_y_speed*=-1;
+    }
+    if(trajectory_y_speed>=-30)
+        trajectory_y_speed-=gravity*time_delta;
+    trajectory_x_speed-=airResistance*time_delta*trajectory_x_speed;
+
+    real width=bodies.width[body_cannonball], height=bodies.height[body_cannonball];
+    real radius=min(width,height)/2;
+    real move[2]={trajectory_x_speed*time_delta,trajectory_y_speed*time_delta};
+    for(int axis=0;axis<2;axis++){ //Along x first and then y, like stepBody
+        real dx = axis==0 ? move[0] : real(0), dy = axis==1 ? move[1] : real(0);
+        gridQuery(trajectory_x+dx/2,trajectory_y+dy/2,width,height,abs(dx)/2,abs(dy)/2,candidates);
+        real first_hit=2;
+        for(int c=0;c<candidates.size();c++){
+            int col=candidates[c];
+            if(col==body_cannonball || (bodies.flags[col]&BODY_ALIVE)==0)
+                continue;
+            first_hit=min(first_hit,sweepCircleBox(trajectory_x,trajectory_y,radius,dx,dy,bodies.x[col],bodies.y[col],boundsWidth(col),boundsHeight(col)));
+        }
+        if(first_hit<=1){
+            trajectory_x+=dx*first_hit;
+            trajectory_y+=dy*first_hit;
+            return 1;
+        }
+        trajectory_x+=dx;
+        trajectory_y+=dy;
+    }
+    return 0;
+}
+
+const TrajectoryPreview &previewTrajectory(double x, double y, double x_speed, double y_speed, int budget_us){
+    double launch[4]={x,y,min(x_speed,30.0),min(y_speed,30.0)}; //Clamped like launchCannonball
+    if(trajectory_steps==0 || !equal(launch,launch+4,trajectory_launch)){
+        copy(launch,launch+4,trajectory_launch);
+        trajectory_x=launch[0];
+        trajectory_y=launch[1];
+        trajectory_x_speed=launch[2];
+        trajectory_y_speed=launch[3];
+        trajectory_steps=0;
+        trajectory.x.assign(1,(float)trajectory_x);
+        trajectory.y.assign(1,(float)trajectory_y);
+        trajectory.done=0;
+    }
+    real time_delta = real(60)/physics_hz;
+    chrono::steady_clock::time_point end = chrono::steady_clock::now()+chrono::microseconds(budget_us);
+    while(!trajectory.done){
+        int hit=trajectoryStep(time_delta);
+        trajectory_steps++;
+        if(hit || trajectory_steps%TRAJECTORY_DOT_STEPS==0){
+            trajectory.x.push_back((float)trajectory_x);
+            trajectory.y.push_back((float)trajectory_y);
+        }
+        if(hit || trajectory_steps>=TRAJECTORY_MAX_STEPS)
+            trajectory.done=1;
+        else if(trajectory_steps%16==0 && chrono::steady_clock::now()>=end) //Out of time, go on next frame
+            break;
+    }
+    return trajectory;
+}
+
+/* History */
+//With recordHistory the whole world is saved after every step into a ring buffer of the last history_length steps:
+//the body store, supports, sensors, pickups, the warm start contacts, the timers and the score. rewindHistory copies
+//one of them back, which is enough to take back a shot or to roll back and step again with different input (the
+//steps are deterministic). The entries are allocated up front and reuse their memory, so saving a step only copies.
+//The level itself (shapes, weights, sensor volumes) never changes while it is played and isn't saved.
+struct WorldState {
+    long long step;
+    vector<real> x,y,prev_x,prev_y,x_speed,y_speed;
+    vector<real> width,height,bounds_width,bounds_height; //The spring switch squashes springbase3
+    vector<int> flags,health,rest_steps,island,exact,rotating,direction;
+    vector<real> angle,rem_angle;
+    LinkLists supported_by,supporting,sensors_inside;
+    vector<int> sensor_enabled;
+    vector<int> pickup_alive;
+    vector<SolverContact> contact_cache;
+    int player_score,player_status,player_reset_timer;
+    ScorePopup score_popup;
+    int spring_state,spring_press;
+    int cannon_recoil,cannon_recoil_dx;
+    real game_tick_accumulator;
+    int bodies_awake;
+    long long shot_step;
+};
+typedef struct WorldState WorldState;
+
+vector<WorldState> history;
+int history_length=0; //Steps kept, 0 when not recording
+int history_count=0; //Entries holding a step, the newest is the one of step_count
+
+void saveWorld(WorldState &state){
+    state.step=step_count;
+    state.x=bodies.x;
+    state.y=bodies.y;
+    state.prev_x=bodies.prev_x;
+    state.prev_y=bodies.prev_y;
+    state.x_speed=bodies.x_speed;
+    state.y_speed=bodies.y_speed;
+    state.width=bodies.width;
+    state.height=bodies.height;
+    state.bounds_width=bodies.bounds_width;
+    state.bounds_height=bodies.bounds_height;
+    state.flags=bodies.flags;
+    state.health=bodies.health;
+    state.rest_steps=bodies.rest_steps;
+    state.island=bodies.island;
+    state.exact=bodies.exact;
+    state.rotating=bodies.rotating;
+    state.direction=bodies.direction;
+    state.angle=bodies.angle;
+    state.rem_angle=bodies.rem_angle;
+    copyLinks(state.supported_by,bodies.supported_by);
+    copyLinks(state.supporting,bodies.supporting);
+    copyLinks(state.sensors_inside,sensors_inside);
+    state.sensor_enabled.resize(sensors.size());
+    for(int i=0;i<sensors.size();i++)
+        state.sensor_enabled[i]=sensors[i].enabled;
+    state.pickup_alive.resize(pickups.size());
+    for(int i=0;i<pickups.size();i++)
+        state.pickup_alive[i]=pickups[i].alive;
+    state.contact_cache=contact_cache;
+    state.player_score=player_score;
+    state.player_status=player_status;
+    state.player_reset_timer=player_reset_timer;
+    state.score_popup=score_popup;
+    state.spring_state=spring_state;
+    state.spring_press=spring_press;
+    state.cannon_recoil=cannon_recoil;
+    state.cannon_recoil_dx=cannon_recoil_dx;
+    state.game_tick_accumulator=game_tick_accumulator;
+    state.bodies_awake=bodies_awake;
+    state.shot_step=shot_step;
+}
+
+void restoreWorld(const WorldState &state){
+    step_count=state.step;
+    bodies.x=state.x;
+    bodies.y=state.y;
+    bodies.prev_x=state.prev_x;
+    bodies.prev_y=state.prev_y;
+    bodies.x_speed=state.x_speed;
+    bodies.y_speed=state.y_speed;
+    bodies.width=state.width;
+    bodies.height=state.height;
+    bodies.bounds_width=state.bounds_width;
+    bodies.bounds_height=state.bounds_height;
+    bodies.flags=state.flags;
+    bodies.health=state.health;
+    bodies.rest_steps=state.rest_steps;
+    bodies.island=state.island;
+    bodies.exact=state.exact;
+    bodies.rotating=state.rotating;
+    bodies.direction=state.direction;
+    bodies.angle=state.angle;
+    bodies.rem_angle=state.rem_angle;
+    copyLinks(bodies.supported_by,state.supported_by);
+    copyLinks(bodies.supporting,state.supporting);
+    copyLinks(sensors_inside,state.sensors_inside);
+    for(int i=0;i<sensors.size();i++)
+        sensors[i].enabled=state.sensor_enabled[i];
+    for(int i=0;i<pickups.size();i++)
+        pickups[i].alive=state.pickup_alive[i];
+    contact_cache=state.contact_cache;
+    player_score=state.player_score;
+    player_status=state.player_status;
+    player_reset_timer=state.player_reset_timer;
+    score_popup=state.score_popup;
+    spring_state=state.spring_state;
+    spring_press=state.spring_press;
+    cannon_recoil=state.cannon_recoil;
+    cannon_recoil_dx=state.cannon_recoil_dx;
+    game_tick_accumulator=state.game_tick_accumulator;
+    bodies_awake=state.bodies_awake;
+    shot_step=state.shot_step;
+
+    //Only the bodies that moved, died or came back change their cells
+    for(int body=0;body<bodies.count;body++){
+        if((bodies.flags[body]&BODY_ALIVE) && bodies.height[body]!=-1)
+            gridUpdate(body);
+        else if(grid_valid[body])
+            gridRemove(body);
+    }
+    solver_contacts.clear();
+    step_events.clear();
+    trajectory_steps=0;
+}
+
+//Called after every step (and when the level is loaded)
+void saveHistory(){
+    if(history_length==0)
+        return;
+    saveWorld(history[step_count%history_length]);
+    history_count=min(history_count+1,history_length);
+}
+
+void recordHistory(int steps){
+    history_length=max(steps,0);
+    history_count=0;
+    history.clear();
+    history.resize(history_length);
+    for(int i=0;i<history_length;i++) //Allocate everything now, so the steps only copy
+        saveWorld(history[i]);
+    saveHistory();
+}
+
+int historySteps(){
+    return max(history_count-1,0);
+}
+
+int rewindHistory(int steps){
+    if(steps<0 || steps>=history_count)
+        return 0;
+    restoreWorld(history[(step_count-steps)%history_length]);
+    history_count-=steps;
+    return 1;
+}
+
+int rewindShot(){
+    if(shot_step<0)
+        return 0;
+    return rewindHistory(step_count-shot_step);
+}
+
+long long stepCount(){
+    return step_count;
+}
+
+//Forget the level and start the game over, before adding the bodies of the next level
+void clearLevel(){
+    level_bodies.clear();
+    pickups.clear();
+    player_score=0;
+    player_status=0;
+    player_reset_timer=0;
+    score_popup=ScorePopup();
+    spring_state=0;
+    spring_press=0;
+    cannon_recoil=0;
+    cannon_recoil_dx=0;
+    game_tick_accumulator=0;
+    trajectory_steps=0;
+    step_count=0;
+    shot_step=-1;
+    contact_cache.clear();
+    history_count=0;
+}
+
+void loadLevel(){
+    COLOR grey = {168.0/255.0,168.0/255.0,168.0/255.0};
+    COLOR coingold = {255.0/255.0,223.0/255.0,0.0/255.0};
+    COLOR lightgreen = {57/255.0,230/255.0,0/255.0};
+    COLOR darkgreen = {51/255.0,102/255.0,0/255.0};
+    COLOR black = {30/255.0,30/255.0,21/255.0};
+    COLOR cratebrown = {153/255.0,102/255.0,0/255.0};
+    COLOR cratebrown1 = {121/255.0,85/255.0,0/255.0};
+    COLOR cratebrown2 = {102/255.0,68/255.0,0/255.0};
+    COLOR lightpink = {255/255.0,122/255.0,173/255.0};
+
+    clearLevel();
+    play_top=250;
+
+    addRectangleBody("skyfloor1",10000,cratebrown1,cratebrown1,cratebrown1,cratebrown1,190,30,20,100,1);
+    addRectangleBody("skyfloor2",10000,cratebrown1,cratebrown1,cratebrown1,cratebrown1,230,60,60,20,1);
+    addRectangleBody("skyfloor3",10000,cratebrown1,cratebrown1,cratebrown1,cratebrown1,270,90,20,100,1);
+    addRectangleBody("springbase1",10000,cratebrown2,cratebrown2,cratebrown2,cratebrown2,190,50,20,40,1);
+    addRectangleBody("springbase2",10000,cratebrown2,cratebrown2,cratebrown2,cratebrown2,190,90,20,40,1);
+    addRectangleBody("springbase3",10000,cratebrown,cratebrown,cratebrown,cratebrown,190,70,40,20,1);
+
+    addRectangleBody("groundfloor1",10000,cratebrown1,cratebrown1,cratebrown1,cratebrown1,-50,-260,20,20,1);
+    addRectangleBody("groundfloor2",10000,cratebrown1,cratebrown1,cratebrown1,cratebrown1,-10,-240,20,100,1);
+    addRectangleBody("groundfloor3",10000,cratebrown1,cratebrown1,cratebrown1,cratebrown1,30,-260,20,20,1);
+
+    addCircleBody("cannonball",2,black,-315,-270,15,10,0,0.3);
+    addRectangleBody("crate1",1,cratebrown,cratebrown2,cratebrown2,cratebrown,160,-100,60,60);
+    addRectangleBody("crate2",1,cratebrown,cratebrown2,cratebrown2,cratebrown,160,-160,30,30);
+    addRectangleBody("crate3",1,cratebrown,cratebrown2,cratebrown2,cratebrown,160,-190,30,30);
+    addRectangleBody("crate4",1,cratebrown,cratebrown2,cratebrown2,cratebrown,160,-220,30,30);
+
+    //On the skyfloor
+    addRectangleBody("crate5",1,cratebrown,cratebrown2,cratebrown2,cratebrown,270,140,40,40);
+
+    //The renderer adds the ears, eyes and noses around these
+    addCircleBody("pig1",1,lightpink,320,-155,20,15);
+    addCircleBody("pig2",1,lightpink,0,-150,20,15);
+    addCircleBody("pig3",1,lightpink,270,255,20,15);
+    addCircleBody("pig4",1,lightpink,160,0,20,15);
+
+    addRectangleBody("floor",10000,lightgreen,lightgreen,lightgreen,lightgreen,0,-300,60,800,1,0.5);
+    addRectangleBody("floor2",10000,darkgreen,lightgreen,lightgreen,darkgreen,0,-290,20,800,1,0.5);
+    addRectangleBody("roof",10000,grey,grey,grey,grey,0,300,60,800,1,0.5);
+    addRectangleBody("wall1",10000,grey,grey,grey,grey,-400,0,600,60,1,0.5);
+    addRectangleBody("wall2",10000,grey,grey,grey,grey,400,0,600,60,1,0.5);
+
+    addPickup("coin1",PICKUP_COIN,coingold,320,-40,15,12);
+    addPickup("coin2",PICKUP_COIN,coingold,20,-40,15,12);
+
+    addPickup("goal1",PICKUP_GOAL,darkgreen,130,-40,15,15);
+    addPickup("goal2",PICKUP_GOAL,darkgreen,-120,150,15,15);
+    addPickup("goal3",PICKUP_GOAL,darkgreen,-320,0,15,15);
+
+    loadBodies();
+    saveHistory();
+}
+
+/* Stress levels - Generated levels for benchmarks */
+//Crates, pigs and coins laid out by a seeded generator, so the same arguments give the same level on every machine
+//(it doesn't use rand or the std distributions, which differ between libraries). The cannon, the ball and the floor
+//are where they are in the game, the level grows to the right of x=-150 and upwards to make room for everything.
+//The objects are named in the order they are laid out, so bodies next to each other get neighbouring handles.
+#define STRESS_LEFT -150 //Everything left of this is kept free for the cannon
+#define STRESS_FLOOR -280 //Top of the floor
+#define STRESS_CELL 45 //Room for one object of the rubble and grid layouts
+
+unsigned stress_random=1;
+
+//xorshift32
+unsigned stressRandom(){
+    stress_random^=stress_random<<13;
+    stress_random^=stress_random>>17;
+    stress_random^=stress_random<<5;
+    return stress_random;
+}
+
+//Uniform in [low,high)
+real stressRange(real low, real high){
+#ifdef FIXED_POINT_PHYSICS
+    return low+fixedRaw(((long long)(high-low).raw*(stressRandom()>>8))>>24);
+#else
+    return low+(high-low)*(stressRandom()>>8)/16777216.0f;
+#endif
+}
+
+string stressName(string kind, int index){
+    char name[32];
+    snprintf(name,sizeof(name),"%s%07d",kind.c_str(),index);
+    return name;
+}
+
+int stressLayout(string name){
+    if(name=="towers")
+        return LAYOUT_TOWERS;
+    if(name=="rubble")
+        return LAYOUT_RUBBLE;
+    if(name=="grid")
+        return LAYOUT_GRID;
+    return -1;
+}
+
+void loadStressLevel(int layout, int crates, int pigs, int coins, unsigned seed){
+    COLOR grey = {168.0/255.0,168.0/255.0,168.0/255.0};
+    COLOR coingold = {255.0/255.0,223.0/255.0,0.0/255.0};
+    COLOR lightgreen = {57/255.0,230/255.0,0/255.0};
+    COLOR darkgreen = {51/255.0,102/255.0,0/255.0};
+    COLOR black = {30/255.0,30/255.0,21/255.0};
+    COLOR cratebrown = {153/255.0,102/255.0,0/255.0};
+    COLOR cratebrown2 = {102/255.0,68/255.0,0/255.0};
+    COLOR lightpink = {255/255.0,122/255.0,173/255.0};
+
+    clearLevel();
+    stress_random = seed!=0 ? seed : 1; //xorshift never leaves 0
+    crates=max(crates,0);
+    pigs=max(pigs,0);
+    coins=max(coins,0);
+    real right=STRESS_LEFT, top=STRESS_FLOOR; //Worked out in real numbers, so the fixed point level is the same everywhere
+    int crate=0, pig=0;
+
+    if(layout==LAYOUT_TOWERS){
+        //About half as many crates high as there are towers, each topped by its share of the pigs
+        int towers=max(1,(int)sqrt((crates+pigs)*2.0));
+        int average=max(1,crates/towers);
+        for(int t=0;crate<crates || pig<pigs;t++){
+            real size=stressRange(20,40);
+            real x=right+stressRange(10,40)+size/2;
+            real y=STRESS_FLOOR;
+            int height=min(crates-crate,average/2+(int)(stressRandom()%(average+1)));
+            for(int i=0;i<height;i++,crate++){
+                addRectangleBody(stressName("crate",crate),1,cratebrown,cratebrown2,cratebrown2,cratebrown,(float)x,(float)(y+size/2),(float)size,(float)size);
+                y+=size;
+            }
+            int on_top = t<towers-1 ? (pigs-pig)/(towers-t) : pigs-pig;
+            for(int i=0;i<on_top;i++,pig++){
+                addCircleBody(stressName("pig",pig),1,lightpink,(float)x,(float)(y+20),20,15);
+                y+=40;
+            }
+            right=x+max(size/2,real(20));
+            top=max(top,y);
+        }
+    }
+    else{
+        //Rows of cells filled column by column, rubble drops random sizes from spread out rows into a heap
+        int objects=crates+pigs;
+        int rows=max(4,(int)sqrt(objects/4.0));
+        real row_height = layout==LAYOUT_RUBBLE ? real(STRESS_CELL*1.5) : real(STRESS_CELL);
+        for(int i=0;i<objects;i++){
+            int column=i/rows, row=i%rows;
+            real x=STRESS_LEFT+(real(column)+real(0.5))*STRESS_CELL;
+            real y=STRESS_FLOOR+(real(row)+real(0.5))*row_height+STRESS_CELL/2;
+            int is_pig;
+            if(layout==LAYOUT_RUBBLE)
+                is_pig = stressRandom()%(unsigned)(objects-i) < (unsigned)(pigs-pig);
+            else //Spread evenly
+                is_pig = (long long)(pig+1)*objects <= (long long)(i+1)*pigs;
+            real size = layout==LAYOUT_RUBBLE ? stressRange(15,40) : real(30);
+            if(is_pig)
+                size=40;
+            if(layout==LAYOUT_RUBBLE){
+                x+=stressRange(-(STRESS_CELL-size)/2,(STRESS_CELL-size)/2);
+                y+=stressRange(0,row_height-STRESS_CELL);
+            }
+            if(is_pig){
+                addCircleBody(stressName("pig",pig),1,lightpink,(float)x,(float)y,20,15);
+                pig++;
+            }
+            else{
+                addRectangleBody(stressName("crate",crate),1,cratebrown,cratebrown2,cratebrown2,cratebrown,(float)x,(float)y,(float)size,(float)size);
+                crate++;
+            }
+            right=max(right,x+STRESS_CELL/2);
+            top=max(top,y+size/2);
+        }
+    }
+
+    //Coins anywhere above the floor
+    play_top=max(real(250),top+50);
+    for(int i=0;i<coins;i++){
+        real x=stressRange(STRESS_LEFT,right), y=stressRange(STRESS_FLOOR+40,play_top);
+        addPickup(stressName("coin",i),PICKUP_COIN,coingold,(float)x,(float)y,15,12);
+    }
+
+    addCircleBody("cannonball",2,black,-315,-270,15,10,0,0.3);
+    real width=right+100+400, height=play_top+300+60;
+    addRectangleBody("floor",10000,lightgreen,lightgreen,lightgreen,lightgreen,(float)(width/2-400),-300,60,(float)width,1,0.5);
+    addRectangleBody("floor2",10000,darkgreen,lightgreen,lightgreen,darkgreen,(float)(width/2-400),-290,20,(float)width,1,0.5);
+    addRectangleBody("roof",10000,grey,grey,grey,grey,(float)(width/2-400),(float)(play_top+50),60,(float)width,1,0.5);
+    addRectangleBody("wall1",10000,grey,grey,grey,grey,-400,(float)(height/2-300),(float)height,60,1,0.5);
+    addRectangleBody("wall2",10000,grey,grey,grey,grey,(float)(right+100),(float)(height/2-300),(float)height,60,1,0.5);
+
+    loadBodies();
+    saveHistory();
+}
+
+int bodyCount(){
+    return bodies.count;
+}
+
+const BodyShape &bodyShape(int body){
+    return bodies.shape[body];
+}
+
+int pickupCount(){
+    return pickups.size();
+}
+
+const Pickup &pickup(int index){
+    return pickups[index];
+}
+
+int playerScore(){
+    return player_score;
+}
+
+const PhysicsStats &physicsStats(){
+    return physics_stats;
+}
+
+const vector<CollisionEvent> &stepEvents(){
+    return step_events;
+}
+
+//The ball was put back after the last shot and nothing moves anymore, stepping further changes nothing
+int shotFinished(){
+    return player_status==0 && bodies_awake==0 && spring_state!=1;
+}
+
+void takeSnapshot(WorldSnapshot &snapshot){
+    snapshot.x.resize(bodies.count);
+    snapshot.y.resize(bodies.count);
+    snapshot.prev_x.resize(bodies.count);
+    snapshot.prev_y.resize(bodies.count);
+    snapshot.height.resize(bodies.count);
+    snapshot.angle.resize(bodies.count);
+    for(int body=0;body<bodies.count;body++){
+        snapshot.x[body]=(float)bodies.x[body];
+        snapshot.y[body]=(float)bodies.y[body];
+        snapshot.prev_x[body]=(float)bodies.prev_x[body];
+        snapshot.prev_y[body]=(float)bodies.prev_y[body];
+        snapshot.height[body]=(float)bodies.height[body];
+        snapshot.angle[body]=(float)bodies.angle[body];
+    }
+    snapshot.flags=bodies.flags;
+    snapshot.health=bodies.health;
+    snapshot.pickup_alive.resize(pickups.size());
+    for(int i=0;i<pickups.size();i++)
+        snapshot.pickup_alive[i]=pickups[i].alive;
+    snapshot.score=player_score;
+    snapshot.popup=score_popup;
+    if(cannon_recoil==1)
+        snapshot.cannon_recoil=16-cannon_recoil_dx;
+    else if(cannon_recoil==2)
+        snapshot.cannon_recoil=cannon_recoil_dx;
+    else
+        snapshot.cannon_recoil=0;
+}
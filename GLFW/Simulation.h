@@ -0,0 +1,179 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <string>
+#include <vector>
+
+/* Simulation - The world of the game without any rendering */
+//Bodies, pickups, score and the game logic that moves them live in libsimulation.a, which doesn't use OpenGL or GLFW.
+//The game draws the world from a WorldSnapshot taken after stepping it, and tools and tests can load the level and
+//step it headless (See Simulate.cpp). The world is global, there is one per process.
+
+struct COLOR {
+    float r;
+    float g;
+    float b;
+};
+typedef struct COLOR COLOR;
+
+#define BODY_ALIVE 1 //status
+#define BODY_FIXED 2 //fixed (Never moves)
+#define BODY_IN_AIR 4 //inAir
+#define BODY_BOUNDARY 8 //The floor, roof and walls of the level (Not clamped to the play area)
+#define BODY_PIG 16 //Gives extra points when destroyed
+#define BODY_SLEEPING 32 //At rest, skipped by the physics until something wakes it
+#define BODY_FAST 64 //Swept against the other bodies so it can't tunnel through them (See sweepMove)
+#define BODY_TRIGGERS 128 //Tested against the sensors (See addSensor)
+
+#define SHAPE_RECTANGLE 0
+#define SHAPE_CIRCLE 1
+
+//How a body or pickup looks, the renderer builds its geometry from this
+struct BodyShape {
+    std::string name;
+    int type; //SHAPE_RECTANGLE or SHAPE_CIRCLE
+    COLOR color[4]; //Corners of a rectangle (bottom left, top left, top right, bottom right), a circle uses the first
+    float width,height;
+    int parts; //Triangles of a circle
+};
+typedef struct BodyShape BodyShape;
+
+#define PICKUP_COIN 0 //Collected by touching it
+#define PICKUP_GOAL 1 //Only there once the spring switch was pressed
+
+//Coins and goals, the cannonball collects them by touching them
+struct Pickup {
+    BodyShape shape;
+    int kind;
+    float x,y;
+    int alive;
+    int points;
+    int sensor; //Its trigger volume
+};
+typedef struct Pickup Pickup;
+
+//Called with the sensor and the body that entered or left it
+typedef void (*SensorCallback)(int sensor, int body);
+
+//The "+100" shown above whatever gave the last points
+struct ScorePopup {
+    int timer; //Game ticks it is still shown for, hidden unless positive
+    char text[3];
+    float x,y; //Centre of the middle character
+    float background_x;
+};
+typedef struct ScorePopup ScorePopup;
+
+#define EVENT_HIT 0 //body hit other, value is the health it took
+#define EVENT_DESTROYED 1 //body destroyed other, value is the points
+#define EVENT_PICKUP 2 //body collected the pickup other, value is the points
+#define EVENT_SWITCH 3 //body pressed the switch other
+
+//Something a collision or sensor caused during a step, (x,y) is the middle of the top edge of what was hit
+struct CollisionEvent {
+    int type;
+    int body,other;
+    float x,y;
+    int value;
+};
+typedef struct CollisionEvent CollisionEvent;
+
+//Predicted flight of the cannonball, see previewTrajectory
+struct TrajectoryPreview {
+    std::vector<float> x,y; //Dots along the path, starting at the launch position
+    int done; //1 once the path is complete, otherwise it is continued by the next call
+};
+typedef struct TrajectoryPreview TrajectoryPreview;
+
+//Everything the renderer needs from the world, indexed like the body store and the pickups
+struct WorldSnapshot {
+    std::vector<float> x,y;
+    std::vector<float> prev_x,prev_y; //Position before the last step (for render interpolation)
+    std::vector<float> angle; //Degrees
+    std::vector<float> height;
+    std::vector<int> flags;
+    std::vector<int> health;
+    std::vector<int> pickup_alive;
+    int score;
+    ScorePopup popup;
+    float cannon_recoil; //How far the cannon is pushed back from its rest position
+};
+typedef struct WorldSnapshot WorldSnapshot;
+
+//What the last step did and where its time went, see physicsStats. With physics_threads>1 the counters are the same
+//as on one thread, the timings are added up over all the threads. The timings stay 0 unless physics_timings is set.
+struct PhysicsStats {
+    int bodies_integrated; //Bodies moved by their speed
+    long long ground_probes; //Tests of whether a body still rests on its supporter
+    long long pairs_tested; //Pairs handed to the narrowphase
+    long long pairs_culled; //Pairs the grid rejected without testing
+    int contacts_resolved; //Contacts the solver worked on
+    int destroyed;
+    double integration_us; //Moving the bodies (and splitting them into groups for the threads), without the collisions
+    double broadphase_us; //Finding the bodies near a moved body in the grid
+    double narrowphase_us; //Testing them for overlaps and pushing the moved body out
+    double response_us; //The contact solver
+    double step_us; //The whole step, including the sleeping, the events and the history
+};
+typedef struct PhysicsStats PhysicsStats;
+
+extern int physics_hz; //Steps per second
+extern int physics_threads; //Threads stepping the physics, set before startIslandWorkers
+extern int bodies_awake; //Non fixed bodies that were simulated during the last step
+extern int solver_iterations; //Passes of the contact solver over all contacts each step (See solveContacts)
+extern int physics_timings; //1 to time the phases of every step, off by default as reading the clock slows the step
+
+/* Building the world */
+void addRectangleBody(std::string name, float weight, COLOR colorA, COLOR colorB, COLOR colorC, COLOR colorD, float x, float y, float height, float width, int fixed=0, float friction=0.4);
+void addCircleBody(std::string name, float weight, COLOR color, float x, float y, float r, int parts, int fixed=0, float friction=0.4);
+void addPickup(std::string name, int kind, COLOR color, float x, float y, float r, int parts);
+void loadBodies(); //Also adds the sensors of the pickups and the spring switch, add other sensors after it
+//Trigger volume tested against the bodies with BODY_TRIGGERS, enter and exit may be NULL
+int addSensor(float x, float y, float width, float height, SensorCallback enter, SensorCallback exit, int data);
+void enableSensor(int sensor, int enabled);
+int sensorData(int sensor);
+void loadLevel(); //The level of the game, loadBodies included
+void clearLevel(); //Start an empty level, then add the bodies and call loadBodies
+
+#define LAYOUT_TOWERS 0 //Columns of crates with the pigs on top
+#define LAYOUT_RUBBLE 1 //Crates of random sizes and pigs dropped into a heap
+#define LAYOUT_GRID 2 //The same crate on a regular lattice with the pigs spread evenly, everything falls at once
+//A generated level for benchmarks, the same arguments always give the same level
+void loadStressLevel(int layout, int crates, int pigs, int coins, unsigned seed);
+int stressLayout(std::string name); //LAYOUT_ of "towers", "rubble" or "grid", -1 for anything else
+void startIslandWorkers();
+
+#define LAUNCH_POWER_MAX (760*760+560*560) //Power of a full power bar
+
+/* Stepping */
+void stepPhysics(); //Advance the world by 1/physics_hz seconds
+int launchCannonball(double x, double y, double x_speed, double y_speed); //1 if the ball was launched
+int fireCannon(double angle, double power); //Launch from the cannon mouth at angle (degrees) with power
+void resetCannonball();
+void cannonLaunch(double angle, double power, double launch[4]); //Position and speed fireCannon launches the ball with
+//Where the ball would fly if it was launched now, until it hits a body. Spends at most budget_us microseconds and
+//continues the same path on the next call with the same launch, so call it every frame while aiming.
+const TrajectoryPreview &previewTrajectory(double x, double y, double x_speed, double y_speed, int budget_us);
+
+/* Queries */
+int bodyCount();
+int bodyHandle(std::string name);
+const BodyShape &bodyShape(int body);
+int pickupCount();
+const Pickup &pickup(int index);
+int playerScore();
+const std::vector<CollisionEvent> &stepEvents(); //Events of the last step, in the order they were applied
+const PhysicsStats &physicsStats(); //Counters and timings of the last step
+int shotFinished(); //1 once the last shot is over and the world is at rest
+void takeSnapshot(WorldSnapshot &snapshot);
+
+/* History */
+//The world after each of the last steps can be kept, to take back a shot or to roll back and step again with other
+//input (for network play). Rewinding only copies memory, it takes microseconds.
+void recordHistory(int steps); //Keep the last steps from now on (0 stops), the memory for them is allocated here
+int historySteps(); //How many steps back rewindHistory can go
+int rewindHistory(int steps); //Back to the world as it was steps steps ago, 0 if that step wasn't kept
+int rewindShot(); //Back to just before the last shot was fired, 0 if that step wasn't kept
+long long stepCount(); //Steps since the level was loaded
+
+#endif
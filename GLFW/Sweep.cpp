@@ -0,0 +1,151 @@
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "Simulation.h"
+
+using namespace std;
+
+/* Sweep - Scores every cannon shot of a grid of launch angles and powers */
+//Usage: ./sweep [angles] [powers] [workers] [output] [max power]
+//Angles go from 0 to 90 degrees and powers from 0 to max power (a full power bar by default), like the 'A','B','S'
+//and 'F' keys. Every shot starts from a fresh copy of the level and runs until it is over.
+//The world is global, so the shots are split between forked worker processes which share nothing but the results.
+//Writes <output>.csv and the heatmaps <output>_score.pgm, <output>_destroyed.pgm and <output>_damage.pgm
+//(angle up, power right).
+
+#define SHOT_MAX_STEPS 2400 //Give up on shots that haven't settled after 20s of game time
+
+struct ShotResult {
+    int score;
+    int destroyed;
+    int damage; //Health taken from all bodies, a single shot rarely destroys anything
+};
+typedef struct ShotResult ShotResult;
+
+int angles, powers;
+double max_power;
+
+//Shots are numbered angle by angle, powers[0..powers-1] for every angle
+double shotAngle(int shot){
+    return angles>1 ? 90.0*(shot/powers)/(angles-1) : 45;
+}
+
+double shotPower(int shot){
+    return powers>1 ? max_power*(shot%powers)/(powers-1) : max_power;
+}
+
+ShotResult runShot(double angle, double power){
+    ShotResult result;
+    loadLevel();
+    fireCannon(angle,power);
+    int step;
+    for(step=0;step<SHOT_MAX_STEPS;step++){
+        stepPhysics();
+        if(shotFinished())
+            break;
+    }
+
+    WorldSnapshot world;
+    takeSnapshot(world);
+    result.score=world.score;
+    result.destroyed=0;
+    result.damage=0;
+    int body;
+    for(body=0;body<bodyCount();body++){
+        if((world.flags[body]&BODY_ALIVE)==0)
+            result.destroyed++;
+        result.damage+=100-world.health[body];
+    }
+    return result;
+}
+
+//Binary greymap scaled so the highest value is white
+void writeHeatmap(string file, const vector<int> &values){
+    int highest = max(1,*max_element(values.begin(),values.end()));
+    ofstream out(file.c_str(),ios::binary);
+    out << "P5\n" << powers << " " << angles << "\n255\n";
+    int a,p;
+    for(a=angles-1;a>=0;a--)
+        for(p=0;p<powers;p++)
+            out.put((char)(values[a*powers+p]*255/highest));
+}
+
+int main (int argc, char** argv)
+{
+    angles = argc>1 ? max(1,atoi(argv[1])) : 91;
+    powers = argc>2 ? max(1,atoi(argv[2])) : 101;
+    int workers = argc>3 ? max(1,atoi(argv[3])) : max(1L,sysconf(_SC_NPROCESSORS_ONLN));
+    string output = argc>4 ? argv[4] : "sweep";
+    max_power = argc>5 ? atof(argv[5]) : LAUNCH_POWER_MAX;
+    int shots = angles*powers;
+
+    //Shared with the workers, each shot is written by exactly one of them
+    ShotResult *results = (ShotResult*)mmap(0,sizeof(ShotResult)*shots,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_ANONYMOUS,-1,0);
+    if(results==MAP_FAILED){
+        cerr << "Could not allocate the results of " << shots << " shots" << endl;
+        return 1;
+    }
+
+    cout << "Sweeping " << angles << " angles x " << powers << " powers on " << workers << " workers" << endl;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    int w;
+    for(w=0;w<workers;w++){
+        pid_t pid = fork();
+        if(pid<0){
+            cerr << "Could not start worker " << w << endl;
+            return 1;
+        }
+        if(pid>0)
+            continue;
+        //Silence the " COIN " messages of the game
+        int null_fd = open("/dev/null",O_WRONLY);
+        if(null_fd>=0)
+            dup2(null_fd,STDOUT_FILENO);
+        int shot;
+        for(shot=w;shot<shots;shot+=workers){ //Interleaved, so every worker gets the same mix of short and long shots
+            results[shot]=runShot(shotAngle(shot),shotPower(shot));
+            if(w==0 && (shot/workers)%1000==0)
+                cerr << "\r" << shot*100/shots << "%" << flush;
+        }
+        _exit(0);
+    }
+    int status, failed=0;
+    while(wait(&status)>0)
+        if(!WIFEXITED(status) || WEXITSTATUS(status)!=0)
+            failed=1;
+    double seconds = chrono::duration<double>(chrono::steady_clock::now()-start).count();
+    cerr << "\r100%" << endl;
+    if(failed){
+        cerr << "A worker failed, the results are incomplete" << endl;
+        return 1;
+    }
+
+    vector<int> score(shots), destroyed(shots), damage(shots);
+    ofstream csv((output+".csv").c_str());
+    csv << "angle,power,score,destroyed,damage" << endl;
+    int shot, best=0;
+    for(shot=0;shot<shots;shot++){
+        score[shot]=results[shot].score;
+        destroyed[shot]=results[shot].destroyed;
+        damage[shot]=results[shot].damage;
+        if(score[shot]>score[best])
+            best=shot;
+        csv << shotAngle(shot) << "," << shotPower(shot) << "," << score[shot] << "," << destroyed[shot] << "," << damage[shot] << "\n";
+    }
+    writeHeatmap(output+"_score.pgm",score);
+    writeHeatmap(output+"_destroyed.pgm",destroyed);
+    writeHeatmap(output+"_damage.pgm",damage);
+
+    cout << shots << " shots in " << seconds << "s (" << shots/seconds << " shots/sec)" << endl;
+    cout << "Best score " << score[best] << " at angle " << shotAngle(best) << " power " << shotPower(best) << endl;
+    munmap(results,sizeof(ShotResult)*shots);
+    return 0;
+}